@@ -0,0 +1,45 @@
+#pragma once
+#include <SDL.h>
+#include <fstream>
+#include <string>
+
+//Input traces record one entry per pass of the editor loop that received an event or rendered
+//(passes spinning on a stale key event are left out):
+//  u8 flags, u32 microseconds since the previous entry, then only what changed:
+//  the new SDL_Event (type plus the fields the handlers read), keyboard state changes
+//  as (scancode, state) pairs and the mouse position.
+//Idle frames therefore cost 5 bytes.
+class InputRecorder
+{
+private:
+    std::ofstream File;
+    Uint8 Keyboard[SDL_NUM_SCANCODES];
+    int Mouse_x;
+    int Mouse_y;
+    Uint64 LastTime;
+
+public:
+    InputRecorder();
+
+    bool Open(const std::string& path);
+    void Record(const SDL_Event* e, const Uint8* keyboard, const int& mouse_x, const int& mouse_y);
+    void Close();
+
+    bool isOpen()
+    {
+        return File.is_open();
+    }
+};
+
+class InputPlayer
+{
+private:
+    std::ifstream File;
+
+public:
+    bool Open(const std::string& path);
+    //Applies the next entry: e is only overwritten when a new event was recorded, exactly like
+    //SDL_PollEvent leaves it untouched on an empty queue, and newEvent is set to match its return.
+    //Returns false at the end of the trace.
+    bool Next(SDL_Event& e, bool& newEvent, Uint8* keyboard, int& mouse_x, int& mouse_y, Uint32& elapsed);
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+//Levels and categories are filtered at compile time: a LOG_* call below LOG_LEVEL or outside
+//LOG_CATEGORIES is discarded by `if constexpr` and its arguments are never evaluated.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF   4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_EDIT   0x01
+#define LOG_EXPORT 0x02
+#define LOG_IMPORT 0x04
+#define LOG_RENDER 0x08
+#define LOG_INPUT  0x10
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES (LOG_EDIT | LOG_EXPORT | LOG_IMPORT | LOG_RENDER | LOG_INPUT)
+#endif
+
+#define LOG(level, category, ...) \
+    do { if constexpr ((level) >= LOG_LEVEL && ((category) & LOG_CATEGORIES)) Log::Push(level, category, __VA_ARGS__); } while (0)
+
+#define LOG_TRACE(category, ...) LOG(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#define LOG_INFO(category, ...)  LOG(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARN(category, ...)  LOG(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+
+namespace Log
+{
+    constexpr unsigned int MaxArguments = 6;
+    constexpr unsigned int MaxRecordText = 512;
+
+    //Arguments are captured by value and only turned into text by the flush thread.
+    //Strings are copied into the record's text area so the caller's buffer may go away immediately;
+    //all string arguments of a record share MaxRecordText bytes.
+    struct Argument
+    {
+        enum : std::uint8_t { INT, UINT, FLOAT, STRING } Type;
+        union
+        {
+            long long i;
+            unsigned long long u;
+            double f;
+            struct { std::uint16_t Offset; std::uint16_t Length; } s;
+        };
+    };
+
+    struct Record
+    {
+        std::int64_t Time;
+        std::uint8_t Level;
+        std::uint8_t Category;
+        std::uint8_t nArguments;
+        std::uint16_t nText;
+        const char* Format; //must be a string literal, "{}" marks each argument
+        Argument Arguments[MaxArguments];
+        char Text[MaxRecordText];
+    };
+
+    //Starts the flush thread. Without a path records go to stderr.
+    bool Start(const char* path = nullptr);
+    //Drains everything still queued and joins the flush thread.
+    //Also runs when the program exits, so returning early from main loses nothing.
+    void Stop();
+    //Non-blocking, lock-free; returns false and counts a drop when the ring is full.
+    bool Enqueue(const Record& record);
+
+    template <typename T> Argument MakeArgument(const T& value, Record& record)
+    {
+        Argument arg;
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            arg.Type = Argument::FLOAT;
+            arg.f = value;
+        }
+        else if constexpr (std::is_same_v<T, bool> || std::is_unsigned_v<T>)
+        {
+            arg.Type = Argument::UINT;
+            arg.u = value;
+        }
+        else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+        {
+            arg.Type = Argument::INT;
+            arg.i = (long long)value;
+        }
+        else
+        {
+            const char* str;
+            if constexpr (std::is_same_v<T, std::string>)
+                str = value.c_str();
+            else
+                str = value;
+
+            if (!str)
+                str = "(null)";
+
+            arg.Type = Argument::STRING;
+            arg.s.Offset = record.nText;
+            arg.s.Length = std::min<std::size_t>(std::strlen(str), MaxRecordText - record.nText);
+            std::memcpy(record.Text + record.nText, str, arg.s.Length);
+            record.nText += arg.s.Length;
+        }
+        return arg;
+    }
+
+    template <typename... Args> void Push(const int& level, const int& category, const char* format, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= MaxArguments, "Too many log arguments");
+
+        Record record;
+        record.Time = std::chrono::steady_clock::now().time_since_epoch().count();
+        record.Level = level;
+        record.Category = category;
+        record.nArguments = sizeof...(Args);
+        record.Format = format;
+        record.nText = 0;
+
+        unsigned int i = 0;
+        ((record.Arguments[i++] = MakeArgument(args, record)), ...);
+        Enqueue(record);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <SDL.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Thumbnails of every exported screen, packed into one atlas texture.
+//Screens are rasterized on a small worker pool into CPU surfaces; the render thread only
+//uploads the cells that finished since the last frame and draws the atlas with one copy.
+class Minimap
+{
+public:
+    static constexpr int ScreenWidth = 1280; //thumbnails are ScreenWidth / ThumbnailWidth times smaller than a screen
+    static constexpr int ThumbnailWidth = 64;
+    static constexpr int ThumbnailHeight = 36;
+    static constexpr int Columns = 8;
+
+    struct Polygon
+    {
+        std::vector<SDL_Point> Verteces; //in editor pixels, scaled down by the worker
+        SDL_Color Color;
+    };
+
+private:
+    struct Job
+    {
+        unsigned int Screen;
+        unsigned int Revision;
+        std::vector<Polygon> Polygons;
+    };
+
+    struct Result
+    {
+        unsigned int Screen;
+        unsigned int Revision;
+        SDL_Surface* Thumbnail;
+    };
+
+    std::vector<std::thread> Workers;
+    std::mutex Lock;
+    std::condition_variable Wake;
+    std::deque<Job> Jobs;
+    std::vector<Result> Results;
+    bool Running;
+
+    std::vector<unsigned int> Requested;  //revision last submitted per screen
+    std::vector<SDL_Surface*> Thumbnails; //CPU copy per screen, kept to refill a regrown atlas
+    SDL_Texture* Atlas;
+    int Rows;
+    bool Visible;
+
+    void Work();
+    bool Upload(const unsigned int& screen);
+
+public:
+    Minimap();
+    ~Minimap();
+
+    //True when the thumbnail for this screen is missing or older than revision
+    bool isStale(const unsigned int& screen, const unsigned int& revision);
+    void Submit(const unsigned int& screen, const unsigned int& revision, std::vector<Polygon>&& polygons);
+    void Render(SDL_Renderer* renderer, const SDL_Rect& panel);
+
+    void Toggle()
+    {
+        Visible = !Visible;
+    }
+};
@@ -1,6 +1,11 @@
 #pragma once
 #include <SDL.h>
 
-extern void SDL_DrawPolygon(SDL_Renderer*& render, SDL_Point *v, int n, const SDL_Color& c);
+#define SDL_CLIPPOLYGON_MAX(N)	((N) * 6)
+
+extern int  SDL_ClipLine(const SDL_Rect *r, int *x0, int *y0, int *x1, int *y1);
+extern int  SDL_ClipPolygon(const SDL_Rect *r, const SDL_Point *v, int n, SDL_Point *out);
+extern void SDL_DrawPolygon(SDL_Renderer*& render, SDL_Point *v, int n, const SDL_Color& c, const SDL_Rect *clip = 0);
 extern void SDL_FillPolygon(SDL_Renderer*& render, SDL_Surface* s, SDL_Point *v, int n, const SDL_Color& c);
+extern void SDL_FillPolygonSurface(SDL_Surface* s, SDL_Point *v, int n, Uint32 pixel);
 
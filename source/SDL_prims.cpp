@@ -33,8 +33,13 @@
 #define max(A, B)	(((A) > (B) ? (A) : (B)))
 #define clamp(A, X, B)	min(max(A, X), B)
 
-#define CLIPX0(S)	((S)->clip_rect.x)
-#define CLIPY0(S)	((S)->clip_rect.y)
+#define RECTX0(R)	((R)->x)
+#define RECTY0(R)	((R)->y)
+#define RECTX1(R)	(RECTX0(R) + (R)->w)
+#define RECTY1(R)	(RECTY0(R) + (R)->h)
+
+#define CLIPX0(S)	RECTX0(&(S)->clip_rect)
+#define CLIPY0(S)	RECTY0(&(S)->clip_rect)
 #define CLIPW(S)	((S)->clip_rect.w)
 #define CLIPH(S)	((S)->clip_rect.h)
 #define CLIPX1(S)	(CLIPX0(S) + CLIPW(S))
@@ -60,21 +65,157 @@
  * Principles and Practice", Addison-Wesley, 1995.  ISBN 0201848406.
  * (Section 3.12.3.) */
 
+/* The clip region is the closed rect [x, x+w] x [y, y+h], so geometry
+ * lying exactly on a screen edge is kept by both clippers. */
+
+#define CLIP_LEFT	1
+#define CLIP_RIGHT	2
+#define CLIP_TOP	4
+#define CLIP_BOTTOM	8
+
+static int SDL_OutCode(const SDL_Rect *r, int x, int y)
+{
+  int code= 0;
+  if      (x < RECTX0(r)) code |= CLIP_LEFT;
+  else if (x > RECTX1(r)) code |= CLIP_RIGHT;
+  if      (y < RECTY0(r)) code |= CLIP_TOP;
+  else if (y > RECTY1(r)) code |= CLIP_BOTTOM;
+  return code;
+}
+
+int SDL_ClipLine(const SDL_Rect *r, int *x0, int *y0, int *x1, int *y1)
+{
+  int c0= SDL_OutCode(r, *x0, *y0);
+  int c1= SDL_OutCode(r, *x1, *y1);
+  for (;;)
+    {
+      if (!(c0 | c1)) return 1;
+      if (c0 & c1)    return 0;
+      int c= c0 ? c0 : c1;
+      double dx= *x1 - *x0, dy= *y1 - *y0;
+      int x, y;
+      if (c & CLIP_TOP)
+	{
+	  y= RECTY0(r);
+	  x= (int)rint(*x0 + dx * (y - *y0) / dy);
+	}
+      else if (c & CLIP_BOTTOM)
+	{
+	  y= RECTY1(r);
+	  x= (int)rint(*x0 + dx * (y - *y0) / dy);
+	}
+      else if (c & CLIP_LEFT)
+	{
+	  x= RECTX0(r);
+	  y= (int)rint(*y0 + dy * (x - *x0) / dx);
+	}
+      else
+	{
+	  x= RECTX1(r);
+	  y= (int)rint(*y0 + dy * (x - *x0) / dx);
+	}
+      if (c == c0) { *x0= x;  *y0= y;  c0= SDL_OutCode(r, x, y); }
+      else         { *x1= x;  *y1= y;  c1= SDL_OutCode(r, x, y); }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* ClipPolygon							    */
+/* ---------------------------------------------------------------- */
+
+/* Sutherland-Hodgman reentrant polygon clipping, one rect edge per
+ * pass.  A pass emits at most 3/2 of its input vertices, hence the
+ * 6n bound on the output (SDL_CLIPPOLYGON_MAX) after four passes. */
+
+static int SDL_Inside(const SDL_Rect *r, int edge, const SDL_Point *p)
+{
+  switch (edge)
+    {
+    case CLIP_LEFT:	return p->x >= RECTX0(r);
+    case CLIP_RIGHT:	return p->x <= RECTX1(r);
+    case CLIP_TOP:	return p->y >= RECTY0(r);
+    default:		return p->y <= RECTY1(r);
+    }
+}
+
+static SDL_Point SDL_Intersect(const SDL_Rect *r, int edge, const SDL_Point *a, const SDL_Point *b)
+{
+  SDL_Point p;
+  double dx= b->x - a->x, dy= b->y - a->y;
+  switch (edge)
+    {
+    case CLIP_LEFT:
+    case CLIP_RIGHT:
+      p.x= (edge == CLIP_LEFT) ? RECTX0(r) : RECTX1(r);
+      p.y= (int)rint(a->y + dy * (p.x - a->x) / dx);
+      break;
+    default:
+      p.y= (edge == CLIP_TOP) ? RECTY0(r) : RECTY1(r);
+      p.x= (int)rint(a->x + dx * (p.y - a->y) / dy);
+      break;
+    }
+  return p;
+}
+
+int SDL_ClipPolygon(const SDL_Rect *r, const SDL_Point *v, int n, SDL_Point *out)
+{
+  static const int edges[4]= { CLIP_LEFT, CLIP_RIGHT, CLIP_TOP, CLIP_BOTTOM };
+  SDL_Point *buf= (SDL_Point *)alloca(sizeof(SDL_Point) * SDL_CLIPPOLYGON_MAX(n));
+  const SDL_Point *in= v;
+  int e, i, j, m;
+  for (e= 0;  e < 4 && n;  ++e)
+    {
+      /* alternate buffers so that the last pass lands in out */
+      SDL_Point *dst= (e & 1) ? out : buf;
+      m= 0;
+      j= n - 1;
+      for (i= 0;  i < n;  j= i++)
+	{
+	  int ii= SDL_Inside(r, edges[e], &in[i]);
+	  int ji= SDL_Inside(r, edges[e], &in[j]);
+	  if (ii != ji) dst[m++]= SDL_Intersect(r, edges[e], &in[j], &in[i]);
+	  if (ii)       dst[m++]= in[i];
+	}
+      in= dst;
+      n= m;
+    }
+  return n;
+}
+
 
 /* ---------------------------------------------------------------- */
 /* DrawPolygon							    */
 /* ---------------------------------------------------------------- */
 
 
-void SDL_DrawPolygon(SDL_Renderer*& render, SDL_Point *v, int n, const SDL_Color& c)
+/* With a clip rect, polygons entirely outside it are culled without
+ * touching the renderer, polygons entirely inside are drawn as-is and
+ * only the ones straddling an edge are clipped edge by edge. */
+
+void SDL_DrawPolygon(SDL_Renderer*& render, SDL_Point *v, int n, const SDL_Color& c, const SDL_Rect *clip)
 {
+  int i, x0, y0, x1, y1;
+  int bx0= v[0].x, by0= v[0].y, bx1= bx0, by1= by0;
+  for (i= 1;  i < n;  ++i)
+    {
+      bx0= min(bx0, v[i].x);  bx1= max(bx1, v[i].x);
+      by0= min(by0, v[i].y);  by1= max(by1, v[i].y);
+    }
+  if (clip && (bx1 < RECTX0(clip) || bx0 > RECTX1(clip) || by1 < RECTY0(clip) || by0 > RECTY1(clip)))
+    return;
+  if (clip && bx0 >= RECTX0(clip) && bx1 <= RECTX1(clip) && by0 >= RECTY0(clip) && by1 <= RECTY1(clip))
+    clip= 0;
+
   SDL_SetRenderDrawColor(render, c.r * 255, c.g * 255, c.b * 255, c.a * 255);
 
   if (n == 1) SDL_RenderDrawPoint(render, v->x, v->y);
-  int i;
-  for (i= 1;  i < n;  ++i)
-    SDL_RenderDrawLine(render, v[i-1].x, v[i-1].y, v[i].x, v[i].y);
-  SDL_RenderDrawLine(render, v[n-1].x, v[n-1].y, v[0].x, v[0].y);
+  int j= n - 1;
+  for (i= 0;  i < n;  j= i++)
+    {
+      x0= v[j].x;  y0= v[j].y;  x1= v[i].x;  y1= v[i].y;
+      if (!clip || SDL_ClipLine(clip, &x0, &y0, &x1, &y1))
+	SDL_RenderDrawLine(render, x0, y0, x1, y1);
+    }
 }
 
 /* ---------------------------------------------------------------- */
@@ -85,23 +226,11 @@ void SDL_DrawPolygon(SDL_Renderer*& render, SDL_Point *v, int n, const SDL_Color
  * the polygon, make an LR ordered list of crossing points.  Successive
  * pairs of points define runs of pixels lying within the polygon. */
 
-void SDL_FillPolygon(SDL_Renderer*& render, SDL_Surface* s, SDL_Point *v, int n, const SDL_Color& c)
+static void SDL_ScanPolygon(SDL_Point *v, int n, int y0, int y1, void (*span)(void *, int, int, int), void *ctx)
 {
-  SDL_SetRenderDrawColor(render, c.r * 255, c.g * 255, c.b * 255, c.a * 255);
-
-  if (n == 1) SDL_RenderDrawPoint(render, v->x, v->y);
   int nxs;
   int* xs = (int*)alloca(sizeof(int) * n);
   int y, i, j, k;
-  int y0= v[0].y, y1= y0;
-  for (i= 1;  i < n;  ++i)
-    {
-      y= v[i].y;
-      if (y < y0) y0= y;
-      if (y > y1) y1= y;
-    }
-  if (y0 < CLIPY0(s)) y0= CLIPY0(s);
-  if (y1 >= CLIPY1(s)) y1= CLIPY1(s) - 1;
   for (y= y0;  y <= y1;  ++y)
     {
       nxs= 0;
@@ -114,6 +243,63 @@ void SDL_FillPolygon(SDL_Renderer*& render, SDL_Surface* s, SDL_Point *v, int n,
 	      swap(int, xs[k-1], xs[k]);
 	  }
       for (i= 0;  i < nxs;  i += 2)
-	SDL_RenderDrawLine(render, xs[i], y, xs[i+1], y);
+	span(ctx, xs[i], xs[i+1], y);
     }
 }
+
+static void SDL_PolygonExtent(SDL_Surface *s, SDL_Point *v, int n, int *y0, int *y1)
+{
+  int i;
+  *y0= *y1= v[0].y;
+  for (i= 1;  i < n;  ++i)
+    {
+      if (v[i].y < *y0) *y0= v[i].y;
+      if (v[i].y > *y1) *y1= v[i].y;
+    }
+  if (*y0 < CLIPY0(s)) *y0= CLIPY0(s);
+  if (*y1 >= CLIPY1(s)) *y1= CLIPY1(s) - 1;
+}
+
+static void SDL_RenderSpan(void *ctx, int x0, int x1, int y)
+{
+  SDL_RenderDrawLine(*(SDL_Renderer **)ctx, x0, y, x1, y);
+}
+
+void SDL_FillPolygon(SDL_Renderer*& render, SDL_Surface* s, SDL_Point *v, int n, const SDL_Color& c)
+{
+  SDL_SetRenderDrawColor(render, c.r * 255, c.g * 255, c.b * 255, c.a * 255);
+
+  if (n == 1) SDL_RenderDrawPoint(render, v->x, v->y);
+  int y0, y1;
+  SDL_PolygonExtent(s, v, n, &y0, &y1);
+  SDL_ScanPolygon(v, n, y0, y1, SDL_RenderSpan, &render);
+}
+
+/* Same fill written straight into the pixels of a 32bpp surface, with
+ * no renderer involved, so it may run on any thread that owns s. */
+
+struct SDL_SurfaceSpanContext
+{
+  SDL_Surface *s;
+  Uint32 pixel;
+};
+
+static void SDL_SurfaceSpan(void *ctx, int x0, int x1, int y)
+{
+  SDL_SurfaceSpanContext *c= (SDL_SurfaceSpanContext *)ctx;
+  SDL_Surface *s= c->s;
+  if (x1 < CLIPX0(s) || x0 >= CLIPX1(s)) return;
+  x0= CLIPX(s, x0);
+  x1= CLIPX(s, x1);
+  Uint32 *p= (Uint32 *)((Uint8 *)s->pixels + y * s->pitch) + x0;
+  for (;  x0 <= x1;  ++x0)
+    *p++= c->pixel;
+}
+
+void SDL_FillPolygonSurface(SDL_Surface* s, SDL_Point *v, int n, Uint32 pixel)
+{
+  SDL_SurfaceSpanContext c= { s, pixel };
+  int y0, y1;
+  SDL_PolygonExtent(s, v, n, &y0, &y1);
+  SDL_ScanPolygon(v, n, y0, y1, SDL_SurfaceSpan, &c);
+}
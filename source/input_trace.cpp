@@ -0,0 +1,174 @@
+//SDL
+#include <SDL.h>
+//STL
+#include <cstring>
+#include <string>
+#include <fstream>
+//vendor
+#include "Logger.h"
+#include "Input_trace.h"
+
+constexpr char InputTraceMagic[4] = {'N', 'Y', 'I', 'T'};
+constexpr unsigned int InputTraceVersion = 1;
+
+enum InputTraceFlags
+{
+    TRACE_EVENT = 1,
+    TRACE_KEYBOARD = 2,
+    TRACE_MOUSE = 4
+};
+
+InputRecorder::InputRecorder()
+    : Mouse_x(0), Mouse_y(0), LastTime(0)
+{
+    std::memset(Keyboard, 0, sizeof(Keyboard));
+}
+
+bool InputRecorder::Open(const std::string& path)
+{
+    File.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!File.is_open())
+    {
+        LOG_ERROR(LOG_INPUT, "Could not open input trace {}", path);
+        return false;
+    }
+
+    File.write(InputTraceMagic, sizeof(InputTraceMagic));
+    File.write((char*)&InputTraceVersion, sizeof(unsigned int));
+    LastTime = SDL_GetPerformanceCounter();
+    LOG_INFO(LOG_INPUT, "Recording input to {}", path);
+    return true;
+}
+
+void InputRecorder::Record(const SDL_Event* e, const Uint8* keyboard, const int& mouse_x, const int& mouse_y)
+{
+    Uint8 Flags = 0;
+    if (e)
+        Flags |= TRACE_EVENT;
+    if (std::memcmp(Keyboard, keyboard, sizeof(Keyboard)))
+        Flags |= TRACE_KEYBOARD;
+    if (mouse_x != Mouse_x || mouse_y != Mouse_y)
+        Flags |= TRACE_MOUSE;
+
+    Uint64 Now = SDL_GetPerformanceCounter();
+    Uint32 Elapsed = (Uint32)((Now - LastTime) * 1000000 / SDL_GetPerformanceFrequency());
+    LastTime = Now;
+
+    File.write((char*)&Flags, sizeof(Uint8));
+    File.write((char*)&Elapsed, sizeof(Uint32));
+
+    if (Flags & TRACE_EVENT)
+    {
+        File.write((char*)&e->type, sizeof(Uint32));
+        if (e->type == SDL_KEYDOWN || e->type == SDL_KEYUP)
+        {
+            Sint32 Scancode = e->key.keysym.scancode;
+            File.write((char*)&Scancode, sizeof(Sint32));
+            File.write((char*)&e->key.repeat, sizeof(Uint8));
+        }
+        else if (e->type == SDL_MOUSEBUTTONDOWN || e->type == SDL_MOUSEBUTTONUP)
+        {
+            File.write((char*)&e->button.button, sizeof(Uint8));
+            File.write((char*)&e->button.x, sizeof(Sint32));
+            File.write((char*)&e->button.y, sizeof(Sint32));
+        }
+    }
+
+    if (Flags & TRACE_KEYBOARD)
+    {
+        Uint16 nChanges = 0;
+        for (int i = 0; i < SDL_NUM_SCANCODES; i++)
+            nChanges += Keyboard[i] != keyboard[i];
+
+        File.write((char*)&nChanges, sizeof(Uint16));
+        for (Uint16 i = 0; i < SDL_NUM_SCANCODES; i++)
+        {
+            if (Keyboard[i] != keyboard[i])
+            {
+                File.write((char*)&i, sizeof(Uint16));
+                File.write((char*)&keyboard[i], sizeof(Uint8));
+                Keyboard[i] = keyboard[i];
+            }
+        }
+    }
+
+    if (Flags & TRACE_MOUSE)
+    {
+        File.write((char*)&mouse_x, sizeof(int));
+        File.write((char*)&mouse_y, sizeof(int));
+        Mouse_x = mouse_x;
+        Mouse_y = mouse_y;
+    }
+}
+
+void InputRecorder::Close()
+{
+    File.close();
+}
+
+bool InputPlayer::Open(const std::string& path)
+{
+    File.open(path, std::ios::in | std::ios::binary);
+
+    char Magic[sizeof(InputTraceMagic)];
+    unsigned int Version = 0;
+    File.read(Magic, sizeof(Magic));
+    File.read((char*)&Version, sizeof(unsigned int));
+
+    if (!File.good() || std::memcmp(Magic, InputTraceMagic, sizeof(Magic)) || Version != InputTraceVersion)
+    {
+        LOG_ERROR(LOG_INPUT, "{} is not an input trace", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool InputPlayer::Next(SDL_Event& e, bool& newEvent, Uint8* keyboard, int& mouse_x, int& mouse_y, Uint32& elapsed)
+{
+    Uint8 Flags;
+    if (!File.read((char*)&Flags, sizeof(Uint8)))
+        return false;
+    File.read((char*)&elapsed, sizeof(Uint32));
+
+    newEvent = Flags & TRACE_EVENT;
+
+    if (Flags & TRACE_EVENT)
+    {
+        std::memset(&e, 0, sizeof(SDL_Event));
+        File.read((char*)&e.type, sizeof(Uint32));
+        if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP)
+        {
+            Sint32 Scancode;
+            File.read((char*)&Scancode, sizeof(Sint32));
+            File.read((char*)&e.key.repeat, sizeof(Uint8));
+            e.key.keysym.scancode = (SDL_Scancode)Scancode;
+        }
+        else if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP)
+        {
+            File.read((char*)&e.button.button, sizeof(Uint8));
+            File.read((char*)&e.button.x, sizeof(Sint32));
+            File.read((char*)&e.button.y, sizeof(Sint32));
+        }
+    }
+
+    if (Flags & TRACE_KEYBOARD)
+    {
+        Uint16 nChanges;
+        File.read((char*)&nChanges, sizeof(Uint16));
+        for (Uint16 i = 0; i < nChanges; i++)
+        {
+            Uint16 Scancode;
+            File.read((char*)&Scancode, sizeof(Uint16));
+            File.read((char*)&keyboard[Scancode % SDL_NUM_SCANCODES], sizeof(Uint8));
+        }
+    }
+
+    if (Flags & TRACE_MOUSE)
+    {
+        File.read((char*)&mouse_x, sizeof(int));
+        File.read((char*)&mouse_y, sizeof(int));
+    }
+
+    return File.good();
+}
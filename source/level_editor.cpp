@@ -10,8 +10,18 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <future>
 //vendor
 #include <SDL_prims.h>
+#include "Logger.h"
+#include "Input_trace.h"
+#include "Minimap.h"
 #include "Level_editor.h"
 
 
@@ -31,6 +41,10 @@ struct Vector2Di
     int y;
 };
 
+//The editing area, which is also the extent of one exported screen
+constexpr SDL_Rect ScreenArea = {0, 0, 1280, 720};
+constexpr SDL_Rect MinimapPanel = {ScreenArea.w - 266, 10, 256, 288};
+
 enum Material
 {
     MAIN = 0,
@@ -50,6 +64,16 @@ Vector2D SDLBox2D(const Vector2D& vec2)
    return Vector2D(vec2.x / 80 - 8, -(vec2.y / 80 - 4.5f));
 }
 
+Vector2D SDLBox2DRelative(const Vector2D& vec2)
+{
+   return Vector2D(vec2.x / 80, -vec2.y / 80);
+}
+
+Vector2D Box2DSDL(const Vector2D& vec2)
+{
+   return Vector2D((vec2.x + 8) * 80, (4.5f - vec2.y) * 80);
+}
+
 float SDLBox2Df(const float& f)
 {
    return f / 80;
@@ -60,6 +84,29 @@ int Dist(const Vector2Di& p1, const Vector2Di& p2)
     return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2));
 }
 
+//Clipping repeats verteces where a polygon touches the clip edge and flattens slivers onto it.
+//Removes the repeats in place and returns the number of verteces left, or 0 when the piece has no area.
+int CleanPolygon(SDL_Point* verteces, int nVerteces)
+{
+    int n = 0;
+    for (int i = 0; i < nVerteces; i++)
+    {
+        if (n && verteces[n - 1].x == verteces[i].x && verteces[n - 1].y == verteces[i].y)
+            continue;
+        verteces[n++] = verteces[i];
+    }
+    while (n > 1 && verteces[n - 1].x == verteces[0].x && verteces[n - 1].y == verteces[0].y)
+        n--;
+
+    if (n < 3)
+        return 0;
+
+    long long Area = 0;
+    for (int i = 0; i < n; i++)
+        Area += (long long)verteces[i].x * verteces[(i + 1) % n].y - (long long)verteces[(i + 1) % n].x * verteces[i].y;
+    return Area ? n : 0;
+}
+
 void DrawCartesianAxis(SDL_Renderer* renderer)
 {
    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 0xFF);
@@ -90,10 +137,20 @@ std::size_t CreatePlatformID()
     return Entities;
 }
 
+std::size_t CreateLevelID()
+{
+    static std::size_t Levels = 0;
+    ++Levels;
+    return Levels;
+}
+
 void RenderText(SDL_Renderer* renderer, const std::string& text, const Vector2Di& position, TTF_Font* font, const SDL_Color& color)
 {
+    if (!font)
+        return;
+
     SDL_Surface* Surface = TTF_RenderText_Solid(font, text.c_str(), color);
-    SDL_Texture* Texture;
+    SDL_Texture* Texture = nullptr;
     SDL_Rect TextArea;
 
     if(Surface)
@@ -107,10 +164,14 @@ void RenderText(SDL_Renderer* renderer, const std::string& text, const Vector2Di
             TextArea.h = Surface->h;
         }
         else
-            printf( "SDL Error: %s\n", SDL_GetError() );
+            LOG_ERROR(LOG_RENDER, "SDL Error: {}", SDL_GetError());
+        SDL_FreeSurface(Surface);
     }
     else
-        printf( "SDL_ttf Error: %s\n", TTF_GetError());
+        LOG_ERROR(LOG_RENDER, "SDL_ttf Error: {}", TTF_GetError());
+
+    if (!Texture)
+        return;
 
     SDL_RenderCopy(renderer, Texture, 0, &TextArea); 
     SDL_DestroyTexture(Texture);
@@ -137,10 +198,8 @@ public:
         SDLVerteces.push_back(SDL_Point(center.x + 20, center.y + 20));
         SDLVerteces.push_back(SDL_Point(center.x + 20, center.y - 20));
     
-        std::cout << "Verteces :  " << SDLVerteces.size() << '\n';
-        std::cout << "StartPos :  " << SDLVerteces[0].x << " | " << SDLVerteces[0].y << '\n';
-        std::string strType = (Type == PlatformType::STATIC) ? "STATIC" : "ANCHOR";
-        std::cout << "Type :  " << strType << '\n'; 
+        LOG_TRACE(LOG_EDIT, "Platform {} : {} verteces, StartPos {} | {}, Type {}", ID, SDLVerteces.size(), SDLVerteces[0].x, SDLVerteces[0].y,
+            (Type == PlatformType::STATIC) ? "STATIC" : "ANCHOR");
     }
 
     Platform(const Vector2Di& startPos, const int& width, const int& height, const int& type = PlatformType::STATIC)
@@ -181,7 +240,7 @@ public:
         else if (Type == PlatformType::ANCHOR)
             color = SDL_Color(1, 0, 1, 1);
 
-        SDL_DrawPolygon(renderer, SDLVerteces.data(), SDLVerteces.size(), color);
+        SDL_DrawPolygon(renderer, SDLVerteces.data(), SDLVerteces.size(), color, &ScreenArea);
     }
 
     bool Collision(const Vector2Di& p)
@@ -227,11 +286,16 @@ public:
         return StartPos;
     }
 
-    std::vector<SDL_Point> GetVerteces()
+    const std::vector<SDL_Point>& GetVerteces()
     {
         return SDLVerteces;
     }
 
+    std::size_t GetVertexCount()
+    {
+        return SDLVerteces.size();
+    }
+
     void SetType(const PlatformType& type)
     {
         Type = type;
@@ -270,7 +334,7 @@ struct Box2DPlatform
     unsigned int Type;
     unsigned int Mat;
 
-    Box2DPlatform(Platform& platform)
+    Box2DPlatform(Platform& platform, Vector2D (*convert)(const Vector2D&) = SDLBox2D)
     {
         std::vector<SDL_Point> SDLVerteces = platform.GetVerteces();
         //[!] There is no check being done to ensure that the verteces are counter-clockwise! [!]
@@ -280,7 +344,7 @@ struct Box2DPlatform
         Verteces = new Vector2D[nVerteces];
         
         for (int i = 0; i < SDLVerteces.size(); ++i)
-            Verteces[i] = SDLBox2D({(float)SDLVerteces[i].x, (float)SDLVerteces[i].y});
+            Verteces[i] = convert({(float)SDLVerteces[i].x, (float)SDLVerteces[i].y});
         
         Mat = platform.GetMaterial();
     }
@@ -293,395 +357,1620 @@ struct Box2DPlatform
     }
 };
 
-struct Screen
-{
-    Vector2D StartPosition;
-    unsigned int nPlatforms;
-    Box2DPlatform* Platforms;
-    //Track Music;
-    //Background Background;
-
-    Screen()
-        : StartPosition({0, 0}), nPlatforms(0), Platforms(nullptr) {}
-};
-
-class Stage
+//A group of platforms saved once and shared by every PrefabInstance that references it.
+//Geometry is stored relative to the prefab origin (top-left grid cell of the group).
+struct Prefab
 {
-public:
     std::vector<Platform> Platforms;
-    std::vector<Box2DPlatform> Box2DPlatforms;
-    std::vector<SDL_Point> EdgeQueue;
-    std::vector<Screen> StageData;
-    Vector2Di StartPosition;
-    unsigned int ScreensExported = 0;
-
-    Stage()
-        : StartPosition({0}) {}
-
-    void AddPlatform(const Platform& platform)
-    {
-        Platforms.push_back(platform);
-    }
+    std::vector<Box2DPlatform> Geometry;
+    int Width;
+    int Height;
 
-    void DeleteSelectedPlatforms()
+    Prefab(const std::vector<Platform>& platforms, const Vector2Di& origin)
+        : Width(0), Height(0)
     {
-        for (int i = 0; i < Platforms.size(); i++)
+        for (int i = 0; i < platforms.size(); ++i)
         {
-            if (Platforms[i].isSelected())
+            Platform platform = platforms[i];
+            platform.Move(Vector2Di(-origin.x, -origin.y));
+            platform.Deselect();
+            Platforms.push_back(platform);
+            Geometry.push_back(Box2DPlatform(Platforms.back(), SDLBox2DRelative));
+
+            std::vector<SDL_Point> SDLVerteces = platform.GetVerteces();
+            for (int j = 0; j < SDLVerteces.size(); ++j)
             {
-                auto it = std::find(Platforms.begin(), Platforms.end(), Platforms[i]);
-                Platforms.erase(it);
+                Width = std::max(Width, SDLVerteces[j].x);
+                Height = std::max(Height, SDLVerteces[j].y);
             }
         }
     }
+};
 
-    void DeletePlatforms(const std::vector<Platform>& platformList)
+//Lightweight placement of a Prefab: only the prefab index and a translation, so copying
+//an instance never touches the shared vertex data.
+class PrefabInstance
+{
+private:
+    unsigned int Source;
+    Vector2Di Offset;
+    bool Selected;
+
+public:
+    PrefabInstance(const unsigned int& source, const Vector2Di& offset)
+        : Source(source), Offset(offset), Selected(0) {}
+
+    void Render(SDL_Renderer* renderer, Prefab& prefab)
     {
-        for (int i = 0; i < Platforms.size(); i++)
+        SDL_Color color(0, 1, 1, 1);
+        if (Selected)
+            color = SDL_Color(0, 1, 0, 1);
+
+        //Reused across instances and frames, so drawing an instance does not allocate
+        static std::vector<SDL_Point> Translated;
+        for (int i = 0; i < prefab.Platforms.size(); ++i)
         {
-            for (int j = 0; j < platformList.size(); j++)
-            {
-                if (platformList[j] == Platforms[i])
-                {
-                    auto it = std::find(Platforms.begin(), Platforms.end(), Platforms[i]);
-                    Platforms.erase(it);
-                }
-            }
+            const std::vector<SDL_Point>& SDLVerteces = prefab.Platforms[i].GetVerteces();
+            Translated.resize(SDLVerteces.size());
+            for (int j = 0; j < SDLVerteces.size(); ++j)
+                Translated[j] = SDL_Point(SDLVerteces[j].x + Offset.x, SDLVerteces[j].y + Offset.y);
+
+            SDL_DrawPolygon(renderer, Translated.data(), Translated.size(), color, &ScreenArea);
         }
     }
 
-    void SetStartPosition(const Vector2Di& mouse)
+    bool Collision(const Vector2Di& p, Prefab& prefab)
     {
-        StartPosition = Vector2Di(div(mouse.x, 40).quot * 40, div(mouse.y, 40).quot * 40);
-        std::cout << "[INFO] Player start position placed at: " << StartPosition.x << " | " << StartPosition.y << '\n';
+        return p.x >= Offset.x && p.x <= Offset.x + prefab.Width && p.y >= Offset.y && p.y <= Offset.y + prefab.Height;
     }
 
-    void AddEdge(const SDL_Point& vec2)
+    void Move(const Vector2Di& amount)
     {
-        EdgeQueue.push_back(vec2);
-        std::cout << "[INFO] Vec2 at x: " << vec2.x << " and y: " << vec2.y << " added to queue" << '\n';
+        Offset.x += amount.x;
+        Offset.y += amount.y;
     }
 
-    void RenderPlatforms(SDL_Renderer* renderer)
+    void Select()
     {
-        for (int i = 0; i < Platforms.size(); i++)
-        {
-            Platforms[i].Render(renderer);
-        }
+        Selected = true;
     }
 
-    void RenderEdges(SDL_Renderer* renderer)
+    bool isSelected()
     {
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderDrawPoints(renderer, EdgeQueue.data(), EdgeQueue.size());
-        SDL_SetRenderDrawColor(renderer, 25, 25, 25, 255);
+        return Selected;
     }
 
-    void ExportScreen()
+    void Deselect()
     {
-        std::cout << "Exporting Level Geometry..." << '\n';
-        Vector2D StartPos = Vector2D(StartPosition.x, StartPosition.y);
-        const unsigned int nPlatforms = Platforms.size();
-        for (int i = 0; i < nPlatforms; i++)
-        {
-            Box2DPlatforms.push_back(Box2DPlatform(Platforms[i]));
-        }
-        
-        Screen screen;
-        screen.nPlatforms = nPlatforms;
-        
-        screen.StartPosition = SDLBox2D(StartPos);
-        screen.Platforms = Box2DPlatforms.data();
-        StageData.push_back(screen);
-        
-        ScreensExported++;
-        Platforms.clear();
-        StartPosition = {0};
+        Selected = false;
     }
 
-    void ExportToFile() //TO DEBUG: Exporting multiple screens with anchors causes access violation!
+    unsigned int GetSource()
     {
-        static int Level = 0;
-        ++Level;
-        std::string Filename = "Level_";
-        Filename += std::to_string(Level);
-        std::fstream Stage;
-        Stage.open(Filename + ".bin", std::ios::out | std::ios::binary);
+        return Source;
+    }
 
-        unsigned int nScreen = StageData.size();
+    Vector2Di GetOffset()
+    {
+        return Offset;
+    }
 
-        Stage.write((char*)&nScreen, sizeof(unsigned int));
-        for (unsigned int i = 0; i < StageData.size(); i++)
+    //Copies of the prefab platforms at this instance's position, for when it has to be cut like plain geometry
+    std::vector<Platform> Expand(Prefab& prefab)
+    {
+        std::vector<Platform> Expanded;
+        std::vector<SDL_Point> Translated;
+        for (int i = 0; i < prefab.Platforms.size(); ++i)
         {
-            Stage.write((char*)&StageData[i].StartPosition.x, sizeof(float));
-            Stage.write((char*)&StageData[i].StartPosition.y, sizeof(float));
-            Stage.write((char*)&StageData[i].nPlatforms, sizeof(unsigned int));
-            for (unsigned int j = 0; j < StageData[i].nPlatforms; j++)
-            {
-                Stage.write((char*)&StageData[i].Platforms[j].nVerteces, sizeof(unsigned int));
-                for(unsigned int l = 0; l < StageData[i].Platforms[j].nVerteces; l++)
-                {
-                    Stage.write((char*)&StageData[i].Platforms[j].Verteces[l].x, sizeof(float)); //nullptr 
-                    Stage.write((char*)&StageData[i].Platforms[j].Verteces[l].y, sizeof(float));
-                }
-                    
-                Stage.write((char*)&StageData[i].Platforms[j].Type, sizeof(unsigned int));
-                Stage.write((char*)&StageData[i].Platforms[j].Mat, sizeof(unsigned int));
-            }
+            const std::vector<SDL_Point>& SDLVerteces = prefab.Platforms[i].GetVerteces();
+            Translated.resize(SDLVerteces.size());
+            for (int j = 0; j < SDLVerteces.size(); ++j)
+                Translated[j] = SDL_Point(SDLVerteces[j].x + Offset.x, SDLVerteces[j].y + Offset.y);
+
+            Expanded.push_back(Platform(Translated, prefab.Platforms[i].GetType(), prefab.Platforms[i].GetMaterial()));
         }
-   
-        Stage.close();
-        StageData.clear();
-        ScreensExported = 0;
-        if (Stage.good())
-            std::cout << "Level data exported succesfully" << '\n';
+        return Expanded;
     }
- 
-    void ExportToFileTest()
+};
+
+struct Box2DInstance
+{
+    unsigned int Prefab;
+    Vector2D Translation;
+
+    Box2DInstance(PrefabInstance& instance)
+        : Prefab(instance.GetSource())
     {
-        std::fstream Stage;
-        Stage.open("Level_1.bin", std::ios::in | std::ios::binary);
+        Vector2Di Offset = instance.GetOffset();
+        Translation = SDLBox2D(Vector2D((float)Offset.x, (float)Offset.y));
+    }
 
-        unsigned int nScreens;
-        Stage.read((char*)&nScreens, sizeof(unsigned int));
-        std::cout << nScreens <<'\n';
-        Screen* ImportedScreens = new Screen[nScreens];
+    Box2DInstance()
+        : Prefab(0), Translation({0, 0}) {}
+};
 
-        for (unsigned int i = 0; i < nScreens; i++)
-        {
-            Stage.read((char*)&ImportedScreens[i].StartPosition.x, sizeof(float));
-            Stage.read((char*)&ImportedScreens[i].StartPosition.y, sizeof(float));
-            std::cout << ImportedScreens[i].StartPosition.x << " | " << ImportedScreens[i].StartPosition.y << '\n';
-            Stage.read((char*)&ImportedScreens[i].nPlatforms, sizeof(unsigned int));
-            std::cout << ImportedScreens[i].nPlatforms << '\n';
-            
-            ImportedScreens[i].Platforms = new Box2DPlatform[ImportedScreens[i].nPlatforms];
-            
-            for (unsigned int j = 0; j < ImportedScreens[i].nPlatforms; j++)
-            {
-                Stage.read((char*)&ImportedScreens[i].Platforms[j].nVerteces, sizeof(unsigned int));
-                std::cout << *(unsigned int*)(char*)&ImportedScreens[i].Platforms[j].nVerteces << '\n';
-                ImportedScreens[i].Platforms[j].Verteces = new Vector2D[ImportedScreens[i].Platforms[j].nVerteces];
+struct Screen
+{
+    Vector2D StartPosition;
+    unsigned int nPlatforms;
+    Box2DPlatform* Platforms;
+    unsigned int nInstances;
+    Box2DInstance* Instances;
+    //Track Music;
+    //Background Background;
 
-                for (unsigned int l = 0; l < ImportedScreens[i].Platforms[j].nVerteces; l++)
-                {
-                    Stage.read((char*)&ImportedScreens[i].Platforms[j].Verteces[l].x, sizeof(float));
-                    Stage.read((char*)&ImportedScreens[i].Platforms[j].Verteces[l].y, sizeof(float));
-                    std::cout << *(float*)(char*)&ImportedScreens[i].Platforms[j].Verteces[l].x << " | " <<
-                    *(float*)(char*)&ImportedScreens[i].Platforms[j].Verteces[l].y << '\n';
-                }
-                    
-                Stage.read((char*)&ImportedScreens[i].Platforms[j].Type, sizeof(unsigned int));
-                std::cout << *(unsigned int*)(char*)&ImportedScreens[i].Platforms[j].Type << '\n';
-                Stage.read((char*)&ImportedScreens[i].Platforms[j].Mat, sizeof(unsigned int));
-                std::cout << *(unsigned int*)(char*)&ImportedScreens[i].Platforms[j].Mat << '\n';
-            }
-        }        
-        
-        Stage.close();
-    }
+    bool Dirty;
+    unsigned int Revision;
 
-    unsigned int GetScreensExported()
+    Screen()
+        : StartPosition({0, 0}), nPlatforms(0), Platforms(nullptr), nInstances(0), Instances(nullptr), Dirty(0), Revision(0) {}
+
+    //Screens are copied around by value, so the arrays are freed explicitly when a screen is replaced
+    void Release()
     {
-        return ScreensExported;
+        for (unsigned int i = 0; i < nPlatforms; i++)
+            delete[] Platforms[i].Verteces;
+        delete[] Platforms;
+        delete[] Instances;
+        nPlatforms = 0;
+        Platforms = nullptr;
+        nInstances = 0;
+        Instances = nullptr;
     }
 };
 
-int main()
+//Level_N.bin layout:
+//  header    : magic, version, offset of the current directory
+//  blocks    : prefab table and screen blocks, in the order they were (re)written
+//  directory : offset/size of the live prefab table and of every screen, by screen index
+//Re-exporting appends the changed blocks and a new directory, so older blocks become dead space.
+constexpr char StageFileMagic[4] = {'N', 'Y', 'L', 'V'};
+constexpr unsigned int StageFileVersion = 2;
+constexpr std::uint64_t StageFileHeaderSize = sizeof(StageFileMagic) + sizeof(unsigned int) + sizeof(std::uint64_t);
+constexpr std::uint64_t StageFileCompactionThreshold = 64 * 1024;
+
+struct StageBlock
 {
-    int Width = 1280;
-    int Height = 720;
+    std::uint64_t Offset;
+    std::uint64_t Size;
+};
 
-    int Mouse_x = 0;
-    int Mouse_y = 0;
+struct StageDirectory
+{
+    StageBlock Prefabs;
+    std::vector<StageBlock> Screens;
+    std::uint64_t FileSize;
 
-    if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
+    StageDirectory()
+        : Prefabs({0, 0}), FileSize(0) {}
+
+    std::uint64_t Size()
     {
-        std::cout << "[SDL2]: SDL_Init() failed   : " << SDL_GetError() << '\n';
-        return 0;
+        return sizeof(unsigned int) + (1 + Screens.size()) * sizeof(StageBlock);
     }
 
-    if (TTF_Init() < 0)
+    std::uint64_t LiveSize()
     {
-        std::cout << "[SDL_ttf]: TTF_Init() failed   : " << TTF_GetError() << '\n';
-        return 0;
+        std::uint64_t Live = StageFileHeaderSize + Prefabs.Size + Size();
+        for (unsigned int i = 0; i < Screens.size(); i++)
+            Live += Screens[i].Size;
+        return Live;
     }
+};
 
-    SDL_Window* Window = SDL_CreateWindow("not_yet_level_editor", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, Width, Height, SDL_WINDOW_SHOWN);
-    if (!Window)
+void WritePlatform(std::fstream& stage, Box2DPlatform& platform)
+{
+    stage.write((char*)&platform.nVerteces, sizeof(unsigned int));
+    for (unsigned int l = 0; l < platform.nVerteces; l++)
     {
-        std::cout << "[SDL_CreateWindow]: Could not create window.   : " << SDL_GetError() << std::endl;
-        return 0;
+        stage.write((char*)&platform.Verteces[l].x, sizeof(float));
+        stage.write((char*)&platform.Verteces[l].y, sizeof(float));
     }
 
-    SDL_Renderer* Renderer = SDL_CreateRenderer(Window, -1, SDL_RENDERER_ACCELERATED + SDL_RENDERER_PRESENTVSYNC);
+    stage.write((char*)&platform.Type, sizeof(unsigned int));
+    stage.write((char*)&platform.Mat, sizeof(unsigned int));
+}
 
-    if (!Renderer)
+std::uint64_t WriteDirectory(std::fstream& stage, StageDirectory& directory)
+{
+    std::uint64_t Offset = stage.tellp();
+    unsigned int nScreens = directory.Screens.size();
+    stage.write((char*)&nScreens, sizeof(unsigned int));
+    stage.write((char*)&directory.Prefabs, sizeof(StageBlock));
+    stage.write((char*)directory.Screens.data(), nScreens * sizeof(StageBlock));
+    return Offset;
+}
+
+bool ReadDirectory(std::fstream& stage, StageDirectory& directory)
+{
+    char Magic[sizeof(StageFileMagic)];
+    unsigned int Version;
+    std::uint64_t DirectoryOffset;
+    stage.read(Magic, sizeof(Magic));
+    stage.read((char*)&Version, sizeof(unsigned int));
+    stage.read((char*)&DirectoryOffset, sizeof(std::uint64_t));
+    if (!stage.good() || !std::equal(Magic, Magic + sizeof(Magic), StageFileMagic) || Version != StageFileVersion)
+        return false;
+
+    unsigned int nScreens;
+    stage.seekg(DirectoryOffset);
+    stage.read((char*)&nScreens, sizeof(unsigned int));
+    stage.read((char*)&directory.Prefabs, sizeof(StageBlock));
+    directory.Screens.resize(nScreens);
+    stage.read((char*)directory.Screens.data(), nScreens * sizeof(StageBlock));
+    return stage.good();
+}
+
+//Copies the live blocks into a fresh file and renames it over the original.
+//Runs on a worker thread; the editor collects the returned directory before touching the file again.
+StageDirectory CompactStageFile(const std::string filename, StageDirectory directory)
+{
+    const std::string Temporary = filename + ".tmp";
+    std::fstream Source;
+    std::fstream Compacted;
+    Source.open(filename, std::ios::in | std::ios::binary);
+    Compacted.open(Temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    std::uint64_t DirectoryOffset = 0;
+    Compacted.write(StageFileMagic, sizeof(StageFileMagic));
+    Compacted.write((char*)&StageFileVersion, sizeof(unsigned int));
+    Compacted.write((char*)&DirectoryOffset, sizeof(std::uint64_t));
+
+    StageDirectory Result = directory;
+    std::vector<char> Buffer;
+    auto CopyBlock = [&](const StageBlock& from, StageBlock& to)
     {
-        std::cout << "[SDL2]: Could not create renderer.   : " << SDL_GetError() << std::endl;
-        return 0;
+        Buffer.resize(from.Size);
+        Source.seekg(from.Offset);
+        Source.read(Buffer.data(), from.Size);
+        to.Offset = Compacted.tellp();
+        Compacted.write(Buffer.data(), from.Size);
+    };
+
+    CopyBlock(directory.Prefabs, Result.Prefabs);
+    for (unsigned int i = 0; i < directory.Screens.size(); i++)
+        CopyBlock(directory.Screens[i], Result.Screens[i]);
+
+    DirectoryOffset = WriteDirectory(Compacted, Result);
+    Result.FileSize = Compacted.tellp();
+    Compacted.seekp(sizeof(StageFileMagic) + sizeof(unsigned int));
+    Compacted.write((char*)&DirectoryOffset, sizeof(std::uint64_t));
+    Compacted.close();
+    Source.close();
+
+    //The error_code overloads: an exception here would only resurface from Compaction.get() on the editor thread
+    std::error_code Error;
+    if (Source.fail() || Compacted.fail())
+    {
+        LOG_WARN(LOG_EXPORT, "Compaction of {} failed, keeping the fragmented file", filename);
+        std::filesystem::remove(Temporary, Error);
+        return directory;
     }
 
-    Stage stage;
+    std::filesystem::rename(Temporary, filename, Error);
+    if (Error)
+    {
+        LOG_WARN(LOG_EXPORT, "Could not replace {} with the compacted file: {}", filename, Error.message().c_str());
+        std::filesystem::remove(Temporary, Error);
+        return directory;
+    }
 
-    SDL_Event e;
-    bool quit = 0;
-    const uint8_t* Keyboard = SDL_GetKeyboardState(0);
-            
-    TTF_Font* MonoFont = TTF_OpenFont("../../res/FreeMono.ttf", 15);
-    if (!MonoFont)
-        std::cout << "[SDL_ttf] TTF_OpenFont() failed   : " << TTF_GetError() << '\n';
+    LOG_INFO(LOG_EXPORT, "{} compacted from {} to {} bytes", filename, directory.FileSize, Result.FileSize);
+    return Result;
+}
+
+enum EditType
+{
+    EDIT_ADD = 0,
+    EDIT_DELETE = 1,
+    EDIT_MOVE = 2,
+    EDIT_RETYPE = 3
+};
+
+//One undoable change, kept as a delta instead of a copy of the stage.
+//Objects are addressed by their (ascending) index in Stage::Platforms / Stage::Instances, which stays valid
+//because edits are only ever undone and redone in order. Platforms and Instances hold the objects that are
+//currently out of the stage: nothing for an add until it is undone, the removed objects for a delete.
+struct Edit
+{
+    EditType Type;
+    bool Chained; //undone and redone together with the edit before it
+    bool Sealed;  //closed for move coalescing
+    std::vector<unsigned int> PlatformIndices;
+    std::vector<unsigned int> InstanceIndices;
+    std::vector<Platform> Platforms;
+    std::vector<PrefabInstance> Instances;
+    std::vector<std::uint8_t> Types; //type of each platform before a retype
+    int NewType;
+    Vector2Di Amount;
+    std::size_t Size;
+
+    Edit(const EditType& type)
+        : Type(type), Chained(0), Sealed(0), NewType(0), Amount({0}), Size(0) {}
 
-    while (!quit + SDL_PollEvent(&e))
+    std::size_t Measure()
     {
-        if (e.type == SDL_QUIT)
-            quit = true;
+        Size = sizeof(Edit) + (PlatformIndices.capacity() + InstanceIndices.capacity()) * sizeof(unsigned int)
+            + Instances.capacity() * sizeof(PrefabInstance) + Types.capacity();
+        for (int i = 0; i < Platforms.size(); i++)
+            Size += sizeof(Platform) + Platforms[i].GetVertexCount() * sizeof(SDL_Point);
+        return Size;
+    }
+};
 
-        else if (e.type == SDL_KEYDOWN)
-        {
-            Keyboard = SDL_GetKeyboardState(0);
-            continue;
-        }
+//Moves items[indices] into erased, keeping the order of both, in one pass over items
+template <typename T>
+void EraseIndices(std::vector<T>& items, const std::vector<unsigned int>& indices, std::vector<T>& erased)
+{
+    if (indices.empty())
+        return;
 
-        else if (e.type == SDL_KEYUP)
+    erased.reserve(indices.size());
+    unsigned int next = 0;
+    unsigned int write = indices[0];
+    for (unsigned int read = write; read < items.size(); read++)
+    {
+        if (next < indices.size() && indices[next] == read)
         {
-            Keyboard = SDL_GetKeyboardState(0);
-            if (!Keyboard[SDL_SCANCODE_LCTRL])
-            {
-                stage.EdgeQueue.clear();
-            }
-            continue;
+            erased.push_back(std::move(items[read]));
+            next++;
         }
-             
-        else if (e.type == SDL_MOUSEBUTTONDOWN)
+        else
+            items[write++] = std::move(items[read]);
+    }
+    items.erase(items.begin() + write, items.end());
+}
+
+//Inverse of EraseIndices: inserted[i] ends up at items[indices[i]]
+template <typename T>
+void InsertIndices(std::vector<T>& items, const std::vector<unsigned int>& indices, std::vector<T>& inserted)
+{
+    if (indices.empty())
+        return;
+
+    std::vector<T> Merged;
+    Merged.reserve(items.size() + inserted.size());
+    unsigned int next = 0;
+    unsigned int read = 0;
+    while (Merged.size() < items.size() + inserted.size())
+    {
+        if (next < indices.size() && indices[next] == Merged.size())
+            Merged.push_back(std::move(inserted[next++]));
+        else
+            Merged.push_back(std::move(items[read++]));
+    }
+    items.swap(Merged);
+    std::vector<T>().swap(inserted);
+}
+
+//Undo/redo stacks with a memory cap. When a new edit pushes the history over the cap, the oldest
+//edits (with everything chained to them) are dropped first.
+class EditHistory
+{
+private:
+    std::deque<Edit> UndoStack;
+    std::vector<Edit> RedoStack;
+    std::size_t Bytes;
+    std::size_t Capacity;
+
+    static void Apply(Edit& edit, const bool& undo, std::vector<Platform>& platforms, std::vector<PrefabInstance>& instances)
+    {
+        switch (edit.Type)
         {
-            if(e.button.button == SDL_BUTTON_LEFT)
+        case EDIT_ADD:
+        case EDIT_DELETE:
+            if (undo == (edit.Type == EDIT_ADD))
             {
-                SDL_GetMouseState(&Mouse_x, &Mouse_y);
-                if (Keyboard[SDL_SCANCODE_LSHIFT])
-                {
-                    Vector2Di cell = Vector2Di((int)(Mouse_x / 40), (int)(Mouse_y / 40));
-                    stage.AddPlatform(Platform(Vector2Di(cell.x * 40 + 20, cell.y * 40 + 20)));
-                }
-
-                else if (Keyboard[SDL_SCANCODE_S])
-                    stage.SetStartPosition(Vector2Di(Mouse_x, Mouse_y));
-                
-                else if (Keyboard[SDL_SCANCODE_LCTRL])
-                {
-                    Vector2Di point = Vector2Di((int)(Mouse_x / 40), (int)(Mouse_y / 40));
-                    stage.AddEdge(SDL_Point(point.x * 40, point.y * 40));
-                }
+                EraseIndices(platforms, edit.PlatformIndices, edit.Platforms);
+                EraseIndices(instances, edit.InstanceIndices, edit.Instances);
             }
-            
-            else if(e.button.button == SDL_BUTTON_RIGHT)
+            else
             {
-                SDL_GetMouseState(&Mouse_x, &Mouse_y);
-                for (int i = 0; i < stage.Platforms.size(); i++)
-                {
-                    if (stage.Platforms[i].Collision(Vector2Di(Mouse_x, Mouse_y)))
-                    {
-                        if (!stage.Platforms[i].isSelected())
-                            stage.Platforms[i].Select();
-                        else
-                            stage.Platforms[i].Deselect();
-                    }    
-                }
+                InsertIndices(platforms, edit.PlatformIndices, edit.Platforms);
+                InsertIndices(instances, edit.InstanceIndices, edit.Instances);
             }
-        }
+            break;
 
-        else if (Keyboard[SDL_SCANCODE_DELETE])
+        case EDIT_MOVE:
         {
-            stage.DeleteSelectedPlatforms();
+            Vector2Di amount = undo ? Vector2Di(-edit.Amount.x, -edit.Amount.y) : edit.Amount;
+            for (int i = 0; i < edit.PlatformIndices.size(); i++)
+                platforms[edit.PlatformIndices[i]].Move(amount);
+            for (int i = 0; i < edit.InstanceIndices.size(); i++)
+                instances[edit.InstanceIndices[i]].Move(amount);
+            break;
         }
-            
-        else if (Keyboard[SDL_SCANCODE_C] && Keyboard[SDL_SCANCODE_LCTRL])
+
+        case EDIT_RETYPE:
+            for (int i = 0; i < edit.PlatformIndices.size(); i++)
+                platforms[edit.PlatformIndices[i]].SetType((PlatformType)(undo ? edit.Types[i] : edit.NewType));
+            break;
+        }
+    }
+
+    void Evict()
+    {
+        unsigned int nEvicted = 0;
+        while (Bytes > Capacity && !UndoStack.empty())
         {
-            if (!stage.EdgeQueue.empty())
+            do
             {
-                stage.AddPlatform(Platform(stage.EdgeQueue));
-                stage.EdgeQueue.clear();
-            }
+                Bytes -= UndoStack.front().Size;
+                UndoStack.pop_front();
+                nEvicted++;
+            } while (!UndoStack.empty() && UndoStack.front().Chained);
         }
-           
-        else if (Keyboard[SDL_SCANCODE_A])
+
+        if (nEvicted)
+            LOG_TRACE(LOG_EDIT, "{} edits dropped from the history, {} bytes kept", nEvicted, Bytes);
+    }
+
+    void Record(Edit&& edit)
+    {
+        for (int i = 0; i < RedoStack.size(); i++)
+            Bytes -= RedoStack[i].Size;
+        RedoStack.clear();
+
+        if (edit.Type == EDIT_MOVE && !edit.Chained && !UndoStack.empty())
         {
-            for (int i = 0; i < stage.Platforms.size(); ++i)
+            Edit& last = UndoStack.back();
+            if (last.Type == EDIT_MOVE && !last.Sealed && last.PlatformIndices == edit.PlatformIndices && last.InstanceIndices == edit.InstanceIndices)
             {
-                if (stage.Platforms[i].isSelected())
-                    stage.Platforms[i].SetType(PlatformType::ANCHOR);
+                last.Amount.x += edit.Amount.x;
+                last.Amount.y += edit.Amount.y;
+                return;
             }
         }
 
-        else if (Keyboard[SDL_SCANCODE_R] && Keyboard[SDL_SCANCODE_LSHIFT])
+        edit.PlatformIndices.shrink_to_fit();
+        edit.InstanceIndices.shrink_to_fit();
+        edit.Types.shrink_to_fit();
+        Bytes += edit.Measure();
+        UndoStack.push_back(std::move(edit));
+    }
+
+    //Eviction runs once the whole group is on the stack, so a group is only ever dropped whole
+    void Commit()
+    {
+        Evict();
+        if (UndoStack.empty())
+            LOG_WARN(LOG_EDIT, "Edit is larger than the {} byte history cap and cannot be undone", Capacity);
+    }
+
+public:
+    EditHistory()
+        : Bytes(0), Capacity(64 * 1024 * 1024) {}
+
+    void SetCapacity(const std::size_t& capacity)
+    {
+        Capacity = capacity;
+        Evict();
+    }
+
+    //Records an edit that was already applied to the stage. Moves of the same selection are merged
+    //into the previous move until it is sealed, so holding an arrow key yields a single entry.
+    void Push(Edit&& edit)
+    {
+        Record(std::move(edit));
+        Commit();
+    }
+
+    //Records two edits that are undone and redone as one step
+    void Push(Edit&& edit, Edit&& chained)
+    {
+        chained.Chained = true;
+        Record(std::move(edit));
+        Record(std::move(chained));
+        Commit();
+    }
+
+    void Seal()
+    {
+        if (!UndoStack.empty())
+            UndoStack.back().Sealed = true;
+    }
+
+    //Both return the number of edits applied, a chained group counts as one step
+    unsigned int Undo(std::vector<Platform>& platforms, std::vector<PrefabInstance>& instances)
+    {
+        unsigned int nEdits = 0;
+        bool chained = true;
+        while (chained && !UndoStack.empty())
         {
-            if (!stage.StageData.empty())
-            stage.ExportToFile();
+            Edit edit = std::move(UndoStack.back());
+            UndoStack.pop_back();
+            Bytes -= edit.Size;
+
+            Apply(edit, true, platforms, instances);
+            edit.Sealed = true;
+            Bytes += edit.Measure();
+            chained = edit.Chained;
+            RedoStack.push_back(std::move(edit));
+            nEdits++;
         }
+        return nEdits;
+    }
 
-        else if (Keyboard[SDL_SCANCODE_E])
+    unsigned int Redo(std::vector<Platform>& platforms, std::vector<PrefabInstance>& instances)
+    {
+        unsigned int nEdits = 0;
+        do
         {
-            if (!stage.Platforms.empty())
-                stage.ExportScreen();
+            if (RedoStack.empty())
+                break;
+
+            Edit edit = std::move(RedoStack.back());
+            RedoStack.pop_back();
+            Bytes -= edit.Size;
+
+            Apply(edit, false, platforms, instances);
+            Bytes += edit.Measure();
+            UndoStack.push_back(std::move(edit));
+            nEdits++;
+        } while (!RedoStack.empty() && RedoStack.back().Chained);
+        return nEdits;
+    }
+
+    void Clear()
+    {
+        UndoStack.clear();
+        RedoStack.clear();
+        Bytes = 0;
+    }
+
+    std::size_t GetBytes()
+    {
+        return Bytes;
+    }
+};
+
+class Stage
+{
+public:
+    std::vector<Platform> Platforms;
+    std::vector<Prefab> Prefabs;
+    std::vector<PrefabInstance> Instances;
+    std::vector<SDL_Point> EdgeQueue;
+    std::vector<Screen> StageData;
+    Vector2Di StartPosition;
+    unsigned int ScreensExported = 0;
+    int CurrentScreen = -1;
+    bool PrefabsDirty = true;
+    std::string Filename;
+    StageDirectory Directory;
+    std::future<StageDirectory> Compaction;
+    Minimap Map;
+    unsigned int Revisions = 0;
+    EditHistory History;
+
+    Stage()
+        : StartPosition({0}), Filename("Level_" + std::to_string(CreateLevelID()) + ".bin") {}
+
+    void AddPlatform(const Platform& platform)
+    {
+        Platforms.push_back(platform);
+
+        Edit edit(EDIT_ADD);
+        edit.PlatformIndices.push_back(Platforms.size() - 1);
+        History.Push(std::move(edit));
+    }
+
+    //Indices of the selected platforms and instances, in the order Edit expects them
+    void GetSelection(Edit& edit)
+    {
+        for (unsigned int i = 0; i < Platforms.size(); i++)
+        {
+            if (Platforms[i].isSelected())
+                edit.PlatformIndices.push_back(i);
         }
 
-        else if (Keyboard[SDL_SCANCODE_T])
+        for (unsigned int i = 0; i < Instances.size(); i++)
         {
-            stage.ExportToFileTest();
+            if (Instances[i].isSelected())
+                edit.InstanceIndices.push_back(i);
         }
-            
-           else if (Keyboard[SDL_SCANCODE_RIGHT])
+    }
+
+    void DeleteSelection()
+    {
+        Edit edit(EDIT_DELETE);
+        GetSelection(edit);
+        if (edit.PlatformIndices.empty() && edit.InstanceIndices.empty())
+            return;
+
+        EraseIndices(Platforms, edit.PlatformIndices, edit.Platforms);
+        EraseIndices(Instances, edit.InstanceIndices, edit.Instances);
+        LOG_INFO(LOG_EDIT, "Deleted {} platforms and {} instances", edit.Platforms.size(), edit.Instances.size());
+        History.Push(std::move(edit));
+    }
+
+    void MoveSelection(const Vector2Di& amount)
+    {
+        Edit edit(EDIT_MOVE);
+        GetSelection(edit);
+        if (edit.PlatformIndices.empty() && edit.InstanceIndices.empty())
+            return;
+
+        for (int i = 0; i < edit.PlatformIndices.size(); i++)
+            Platforms[edit.PlatformIndices[i]].Move(amount);
+        for (int i = 0; i < edit.InstanceIndices.size(); i++)
+            Instances[edit.InstanceIndices[i]].Move(amount);
+
+        edit.Amount = amount;
+        History.Push(std::move(edit));
+    }
+
+    void RetypeSelection(const PlatformType& type)
+    {
+        Edit edit(EDIT_RETYPE);
+        edit.NewType = type;
+        for (unsigned int i = 0; i < Platforms.size(); i++)
         {
-            for (int i = 0; i < stage.Platforms.size(); i++)
+            if (Platforms[i].isSelected() && Platforms[i].GetType() != type)
             {
-                if(!stage.Platforms.empty() && stage.Platforms[i].isSelected())
-                    stage.Platforms[i].Move(Vector2Di(4, 0));
+                edit.PlatformIndices.push_back(i);
+                edit.Types.push_back(Platforms[i].GetType());
+                Platforms[i].SetType(type);
             }
         }
-        if (Keyboard[SDL_SCANCODE_LEFT])
+
+        if (!edit.PlatformIndices.empty())
+            History.Push(std::move(edit));
+    }
+
+    void Undo()
+    {
+        if (History.Undo(Platforms, Instances))
+            LOG_INFO(LOG_EDIT, "Undo, history holds {} bytes", History.GetBytes());
+    }
+
+    void Redo()
+    {
+        if (History.Redo(Platforms, Instances))
+            LOG_INFO(LOG_EDIT, "Redo, history holds {} bytes", History.GetBytes());
+    }
+
+    void DeletePlatforms(const std::vector<Platform>& platformList)
+    {
+        for (int i = 0; i < Platforms.size(); i++)
         {
-            for (int i = 0; i < stage.Platforms.size(); i++)
+            for (int j = 0; j < platformList.size(); j++)
             {
-                if(!stage.Platforms.empty() && stage.Platforms[i].isSelected())
-                    stage.Platforms[i].Move(Vector2Di(-4, 0));
+                if (platformList[j] == Platforms[i])
+                {
+                    auto it = std::find(Platforms.begin(), Platforms.end(), Platforms[i]);
+                    Platforms.erase(it);
+                }
             }
         }
-        if (Keyboard[SDL_SCANCODE_UP])
+    }
+
+    void CreatePrefabFromSelection()
+    {
+        std::vector<Platform> Selection;
+        Edit Removal(EDIT_DELETE);
+        Vector2Di Origin = Vector2Di(INT_MAX, INT_MAX);
+        for (int i = 0; i < Platforms.size(); i++)
         {
-            for (int i = 0; i < stage.Platforms.size(); i++)
+            if (Platforms[i].isSelected())
             {
-                if(!stage.Platforms.empty() && stage.Platforms[i].isSelected())
-                    stage.Platforms[i].Move(Vector2Di(0, -4));
+                Selection.push_back(Platforms[i]);
+                Removal.PlatformIndices.push_back(i);
+                std::vector<SDL_Point> SDLVerteces = Platforms[i].GetVerteces();
+                for (int j = 0; j < SDLVerteces.size(); ++j)
+                {
+                    Origin.x = std::min(Origin.x, SDLVerteces[j].x);
+                    Origin.y = std::min(Origin.y, SDLVerteces[j].y);
+                }
             }
         }
-        if (Keyboard[SDL_SCANCODE_DOWN])
+
+        if (Selection.empty())
+            return;
+
+        Origin = Vector2Di(div(Origin.x, 40).quot * 40, div(Origin.y, 40).quot * 40);
+        Prefabs.push_back(Prefab(Selection, Origin));
+        PrefabsDirty = true;
+        EraseIndices(Platforms, Removal.PlatformIndices, Removal.Platforms);
+
+        Instances.push_back(PrefabInstance(Prefabs.size() - 1, Origin));
+        Instances.back().Select();
+
+        //Undoing brings the platforms back and removes the instance, the prefab itself stays in the table
+        Edit Placement(EDIT_ADD);
+        Placement.InstanceIndices.push_back(Instances.size() - 1);
+        History.Push(std::move(Removal), std::move(Placement));
+        LOG_INFO(LOG_EDIT, "Prefab {} created from {} platforms", Prefabs.size() - 1, Selection.size());
+    }
+
+    void PlaceInstance(const Vector2Di& mouse)
+    {
+        if (Prefabs.empty())
+            return;
+
+        Instances.push_back(PrefabInstance(Prefabs.size() - 1, Vector2Di(div(mouse.x, 40).quot * 40, div(mouse.y, 40).quot * 40)));
+
+        Edit edit(EDIT_ADD);
+        edit.InstanceIndices.push_back(Instances.size() - 1);
+        History.Push(std::move(edit));
+    }
+
+    void DuplicateSelectedInstances(const Vector2Di& amount)
+    {
+        const unsigned int nInstances = Instances.size();
+        for (int i = 0; i < nInstances; i++)
         {
-            for (int i = 0; i < stage.Platforms.size(); i++)
+            if (Instances[i].isSelected())
+            {
+                PrefabInstance Copy = Instances[i];
+                Copy.Move(amount);
+                Instances[i].Deselect();
+                Instances.push_back(Copy);
+            }
+        }
+
+        if (Instances.size() == nInstances)
+            return;
+
+        Edit edit(EDIT_ADD);
+        for (unsigned int i = nInstances; i < Instances.size(); i++)
+            edit.InstanceIndices.push_back(i);
+        History.Push(std::move(edit));
+    }
+
+    void SetStartPosition(const Vector2Di& mouse)
+    {
+        StartPosition = Vector2Di(div(mouse.x, 40).quot * 40, div(mouse.y, 40).quot * 40);
+        LOG_INFO(LOG_EDIT, "Player start position placed at: {} | {}", StartPosition.x, StartPosition.y);
+    }
+
+    void AddEdge(const SDL_Point& vec2)
+    {
+        EdgeQueue.push_back(vec2);
+        LOG_INFO(LOG_EDIT, "Vec2 at x: {} and y: {} added to queue", vec2.x, vec2.y);
+    }
+
+    void RenderPlatforms(SDL_Renderer* renderer)
+    {
+        for (int i = 0; i < Platforms.size(); i++)
+        {
+            Platforms[i].Render(renderer);
+        }
+
+        for (int i = 0; i < Instances.size(); i++)
+        {
+            Instances[i].Render(renderer, Prefabs[Instances[i].GetSource()]);
+        }
+    }
+
+    //Only screens whose revision changed since their last thumbnail are sent to the minimap workers
+    void RenderMinimap(SDL_Renderer* renderer)
+    {
+        for (unsigned int i = 0; i < StageData.size(); i++)
+        {
+            Screen& screen = StageData[i];
+            if (!Map.isStale(i, screen.Revision))
+                continue;
+
+            std::vector<Minimap::Polygon> Polygons;
+            for (unsigned int j = 0; j < screen.nPlatforms; j++)
             {
-                if(!stage.Platforms.empty() && stage.Platforms[i].isSelected())
-                    stage.Platforms[i].Move(Vector2Di(0, 4));
+                Minimap::Polygon polygon;
+                polygon.Color = (screen.Platforms[j].Type == PlatformType::ANCHOR) ? SDL_Color(220, 0, 220, 255) : SDL_Color(220, 220, 220, 255);
+                for (unsigned int l = 0; l < screen.Platforms[j].nVerteces; l++)
+                {
+                    Vector2D vertex = Box2DSDL(screen.Platforms[j].Verteces[l]);
+                    polygon.Verteces.push_back(SDL_Point((int)std::lround(vertex.x), (int)std::lround(vertex.y)));
+                }
+                Polygons.push_back(std::move(polygon));
+            }
+
+            for (unsigned int j = 0; j < screen.nInstances; j++)
+            {
+                Vector2D offset = Box2DSDL(screen.Instances[j].Translation);
+                Prefab& prefab = Prefabs[screen.Instances[j].Prefab];
+                for (int k = 0; k < prefab.Platforms.size(); k++)
+                {
+                    Minimap::Polygon polygon;
+                    polygon.Color = SDL_Color(0, 200, 200, 255);
+                    const std::vector<SDL_Point>& SDLVerteces = prefab.Platforms[k].GetVerteces();
+                    for (int l = 0; l < SDLVerteces.size(); l++)
+                        polygon.Verteces.push_back(SDL_Point(SDLVerteces[l].x + (int)std::lround(offset.x), SDLVerteces[l].y + (int)std::lround(offset.y)));
+                    Polygons.push_back(std::move(polygon));
+                }
             }
-        }    
 
-        SDL_SetRenderDrawColor(Renderer, 25, 25, 25, 255);
-        SDL_RenderClear(Renderer);
+            Map.Submit(i, screen.Revision, std::move(Polygons));
+        }
+
+        Map.Render(renderer, MinimapPanel);
+    }
 
-        DrawGridline(40, Renderer);
-        DrawCartesianAxis(Renderer);        
+    void RenderEdges(SDL_Renderer* renderer)
+    {
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_RenderDrawPoints(renderer, EdgeQueue.data(), EdgeQueue.size());
+        SDL_SetRenderDrawColor(renderer, 25, 25, 25, 255);
+    }
 
-        std::stringstream info;
+    //Platforms and prefab instances with geometry outside this screen and the next one,
+    //which export would have to drop
+    unsigned int CountOutOfReach()
+    {
+        const SDL_Rect Reach = {ScreenArea.x, ScreenArea.y, 2 * ScreenArea.w, ScreenArea.h};
+        auto Outside = [&](const int& x, const int& y)
+            { return x < Reach.x || y < Reach.y || x > Reach.x + Reach.w || y > Reach.y + Reach.h; };
+
+        unsigned int nOutside = 0;
+        for (int i = 0; i < Platforms.size(); i++)
+        {
+            const std::vector<SDL_Point>& SDLVerteces = Platforms[i].GetVerteces();
+            nOutside += std::any_of(SDLVerteces.begin(), SDLVerteces.end(), [&](const SDL_Point& v) { return Outside(v.x, v.y); });
+        }
+
+        for (int i = 0; i < Instances.size(); i++)
+        {
+            Vector2Di Offset = Instances[i].GetOffset();
+            Prefab& prefab = Prefabs[Instances[i].GetSource()];
+            nOutside += Outside(Offset.x, Offset.y) || Outside(Offset.x + prefab.Width, Offset.y + prefab.Height);
+        }
+        return nOutside;
+    }
+
+    //Cuts platforms that cross the screen boundary. The piece inside the screen is kept for export and
+    //the piece overhanging the right edge is carried into the next screen. Prefab instances lying wholly
+    //in the next screen are carried as instances, instances straddling the edge are expanded into
+    //platforms and cut like them. ExportScreen refuses to run while anything lies outside those two
+    //screens, so no geometry is lost here.
+    void SplitAtScreenEdge(std::vector<Platform>& carried, std::vector<PrefabInstance>& carriedInstances)
+    {
+        const SDL_Rect NextScreen = {ScreenArea.x + ScreenArea.w, ScreenArea.y, ScreenArea.w, ScreenArea.h};
+        std::vector<PrefabInstance> Kept;
+        unsigned int nExpanded = 0;
+
+        for (int i = 0; i < Instances.size(); i++)
+        {
+            Vector2Di Offset = Instances[i].GetOffset();
+            Prefab& prefab = Prefabs[Instances[i].GetSource()];
+            if (Offset.x + prefab.Width <= ScreenArea.x + ScreenArea.w)
+                Kept.push_back(Instances[i]);
+            else if (Offset.x >= NextScreen.x)
+            {
+                carriedInstances.push_back(Instances[i]);
+                carriedInstances.back().Move(Vector2Di(-ScreenArea.w, 0));
+            }
+            else
+            {
+                std::vector<Platform> Expanded = Instances[i].Expand(prefab);
+                Platforms.insert(Platforms.end(), Expanded.begin(), Expanded.end());
+                nExpanded++;
+            }
+        }
+        Instances = Kept;
+
+        if (nExpanded)
+            LOG_INFO(LOG_EXPORT, "{} prefab instances cross the screen edge and are exported as platforms", nExpanded);
+
+        std::vector<Platform> Inside;
+        std::vector<SDL_Point> Clipped;
+
+        for (int i = 0; i < Platforms.size(); i++)
+        {
+            std::vector<SDL_Point> SDLVerteces = Platforms[i].GetVerteces();
+            Clipped.resize(SDL_CLIPPOLYGON_MAX(SDLVerteces.size()));
+
+            int nClipped = SDL_ClipPolygon(&ScreenArea, SDLVerteces.data(), SDLVerteces.size(), Clipped.data());
+            if (nClipped == SDLVerteces.size() && std::equal(SDLVerteces.begin(), SDLVerteces.end(), Clipped.begin(),
+                [](const SDL_Point& a, const SDL_Point& b) { return a.x == b.x && a.y == b.y; }))
+            {
+                Inside.push_back(Platforms[i]);
+                continue;
+            }
+
+            nClipped = CleanPolygon(Clipped.data(), nClipped);
+            if (nClipped)
+                Inside.push_back(Platform(std::vector<SDL_Point>(Clipped.begin(), Clipped.begin() + nClipped), Platforms[i].GetType(), Platforms[i].GetMaterial()));
+
+            nClipped = SDL_ClipPolygon(&NextScreen, SDLVerteces.data(), SDLVerteces.size(), Clipped.data());
+            nClipped = CleanPolygon(Clipped.data(), nClipped);
+            if (nClipped)
+            {
+                Platform Piece(std::vector<SDL_Point>(Clipped.begin(), Clipped.begin() + nClipped), Platforms[i].GetType(), Platforms[i].GetMaterial());
+                Piece.Move(Vector2Di(-ScreenArea.w, 0));
+                carried.push_back(Piece);
+            }
+        }
+
+        if (!carried.empty() || !carriedInstances.empty())
+            LOG_INFO(LOG_EXPORT, "{} platform pieces and {} instances carried over to the next screen", carried.size(), carriedInstances.size());
+
+        Platforms = Inside;
+    }
+
+    //Appends carried geometry to an already exported screen and marks it for re-export
+    void MergeIntoScreen(const unsigned int& index, std::vector<Platform>& platforms, std::vector<PrefabInstance>& instances)
+    {
+        Screen& screen = StageData[index];
+
+        //The copies take over the vertex arrays, so only the old outer arrays are freed
+        Box2DPlatform* MergedPlatforms = new Box2DPlatform[screen.nPlatforms + platforms.size()];
+        std::copy(screen.Platforms, screen.Platforms + screen.nPlatforms, MergedPlatforms);
+        for (unsigned int i = 0; i < platforms.size(); i++)
+            MergedPlatforms[screen.nPlatforms + i] = Box2DPlatform(platforms[i]);
+        delete[] screen.Platforms;
+        screen.Platforms = MergedPlatforms;
+        screen.nPlatforms += platforms.size();
+
+        Box2DInstance* MergedInstances = new Box2DInstance[screen.nInstances + instances.size()];
+        std::copy(screen.Instances, screen.Instances + screen.nInstances, MergedInstances);
+        for (unsigned int i = 0; i < instances.size(); i++)
+            MergedInstances[screen.nInstances + i] = Box2DInstance(instances[i]);
+        delete[] screen.Instances;
+        screen.Instances = MergedInstances;
+        screen.nInstances += instances.size();
+
+        screen.Dirty = true;
+        screen.Revision = ++Revisions;
+        LOG_INFO(LOG_EXPORT, "{} platform pieces and {} instances merged into screen {}", platforms.size(), instances.size(), index);
+    }
+
+    void ExportScreen()
+    {
+        unsigned int nOutside = CountOutOfReach();
+        if (nOutside)
+        {
+            LOG_WARN(LOG_EXPORT, "{} platforms or instances reach past the screen edges and would be cut off, move them back before exporting", nOutside);
+            return;
+        }
+
+        LOG_INFO(LOG_EXPORT, "Exporting Level Geometry...");
+        Vector2D StartPos = Vector2D(StartPosition.x, StartPosition.y);
+        std::vector<Platform> Carried;
+        std::vector<PrefabInstance> CarriedInstances;
+        SplitAtScreenEdge(Carried, CarriedInstances);
+        
+        Screen screen;
+        screen.nPlatforms = Platforms.size();
+        screen.Platforms = new Box2DPlatform[screen.nPlatforms];
+        for (int i = 0; i < screen.nPlatforms; i++)
+            screen.Platforms[i] = Box2DPlatform(Platforms[i]);
         
+        screen.StartPosition = SDLBox2D(StartPos);
 
-        info << "Screens exported: " << stage.GetScreensExported();
-        RenderText(Renderer, "not_yet Level Editor", {10, 10}, MonoFont, SDL_Color(255, 255, 255, 150));
-        RenderText(Renderer, "by memcpy", {10, 22}, MonoFont, SDL_Color(255, 255, 255, 150));
-        RenderText(Renderer, info.str().c_str(), {10, 34}, MonoFont, SDL_Color(255, 255, 255, 150));
+        screen.nInstances = Instances.size();
+        screen.Instances = new Box2DInstance[screen.nInstances];
+        for (int i = 0; i < screen.nInstances; i++)
+            screen.Instances[i] = Box2DInstance(Instances[i]);
+
+        screen.Dirty = true;
+        screen.Revision = ++Revisions;
+
+        if (CurrentScreen < 0)
+        {
+            StageData.push_back(screen);
+            ScreensExported++;
+        }
+        else
+        {
+            StageData[CurrentScreen].Release();
+            StageData[CurrentScreen] = screen;
+
+            //The overhang of a screen in the middle of the stage belongs to the screen after it
+            if (CurrentScreen + 1 < StageData.size() && (!Carried.empty() || !CarriedInstances.empty()))
+            {
+                MergeIntoScreen(CurrentScreen + 1, Carried, CarriedInstances);
+                Carried.clear();
+                CarriedInstances.clear();
+            }
+            CurrentScreen = -1;
+        }
         
+        Platforms = Carried;
+        Instances = CarriedInstances;
+        StartPosition = {0};
+        History.Clear();
+    }
+
+    //Brings an exported screen back into the editor so it can be fixed and re-exported with E
+    void EditScreen(const int& index)
+    {
+        if (index < 0 || index >= StageData.size())
+            return;
+
+        if (!Platforms.empty() || !Instances.empty())
+        {
+            LOG_WARN(LOG_EDIT, "Export or clear the current screen before editing screen {}", index);
+            return;
+        }
+
+        Screen& screen = StageData[index];
+        for (unsigned int i = 0; i < screen.nPlatforms; i++)
+        {
+            std::vector<SDL_Point> SDLVerteces;
+            for (unsigned int j = 0; j < screen.Platforms[i].nVerteces; j++)
+            {
+                Vector2D vertex = Box2DSDL(screen.Platforms[i].Verteces[j]);
+                SDLVerteces.push_back(SDL_Point((int)std::lround(vertex.x), (int)std::lround(vertex.y)));
+            }
+
+            Platforms.push_back(Platform(SDLVerteces, screen.Platforms[i].Type, (Material)screen.Platforms[i].Mat));
+        }
+
+        for (unsigned int i = 0; i < screen.nInstances; i++)
+        {
+            Vector2D offset = Box2DSDL(screen.Instances[i].Translation);
+            Instances.push_back(PrefabInstance(screen.Instances[i].Prefab, Vector2Di((int)std::lround(offset.x), (int)std::lround(offset.y))));
+        }
+
+        Vector2D StartPos = Box2DSDL(screen.StartPosition);
+        StartPosition = Vector2Di((int)std::lround(StartPos.x), (int)std::lround(StartPos.y));
+        CurrentScreen = index;
+        History.Clear();
+        LOG_INFO(LOG_EDIT, "Editing screen {}", index);
+    }
+
+    //Patches the stage file in place: only dirty screens (and the prefab table, when it changed)
+    //are appended, then a new directory is written and the header is repointed to it.
+    //The header write is the commit point, a crash before it leaves the previous directory valid.
+    void ExportToFile()
+    {
+        if (Compaction.valid())
+            Directory = Compaction.get();
+
+        //The file went missing since the last export: start over with every block
+        if (Directory.FileSize && !std::filesystem::exists(Filename))
+        {
+            LOG_WARN(LOG_EXPORT, "{} no longer exists, writing it from scratch", Filename);
+            Directory = StageDirectory();
+            PrefabsDirty = true;
+            for (unsigned int i = 0; i < StageData.size(); i++)
+                StageData[i].Dirty = true;
+        }
+
+        unsigned int nDirty = PrefabsDirty;
+        for (unsigned int i = 0; i < StageData.size(); i++)
+            nDirty += StageData[i].Dirty;
+
+        if (!nDirty && Directory.FileSize)
+        {
+            LOG_INFO(LOG_EXPORT, "{} is up to date", Filename);
+            return;
+        }
+
+        std::fstream Stage;
+        if (!Directory.FileSize)
+        {
+            Stage.open(Filename, std::ios::out | std::ios::binary | std::ios::trunc);
+            Stage.write(StageFileMagic, sizeof(StageFileMagic));
+            Stage.write((char*)&StageFileVersion, sizeof(unsigned int));
+            std::uint64_t DirectoryOffset = 0;
+            Stage.write((char*)&DirectoryOffset, sizeof(std::uint64_t));
+            Stage.close();
+        }
+
+        Stage.open(Filename, std::ios::in | std::ios::out | std::ios::binary);
+        if (!Stage.is_open())
+        {
+            LOG_ERROR(LOG_EXPORT, "Could not open {} for writing, nothing was exported", Filename);
+            return;
+        }
+        Stage.seekp(0, std::ios::end);
+
+        //Blocks go into a copy of the directory, which only replaces Directory (and clears the
+        //dirty flags) once every write made it to the file
+        StageDirectory Written = Directory;
+
+        //Prefab geometry is written once, screens reference it through their instance table
+        if (PrefabsDirty)
+        {
+            Written.Prefabs.Offset = Stage.tellp();
+            unsigned int nPrefabs = Prefabs.size();
+            Stage.write((char*)&nPrefabs, sizeof(unsigned int));
+            for (unsigned int i = 0; i < nPrefabs; i++)
+            {
+                unsigned int nPlatforms = Prefabs[i].Geometry.size();
+                Stage.write((char*)&nPlatforms, sizeof(unsigned int));
+                for (unsigned int j = 0; j < nPlatforms; j++)
+                    WritePlatform(Stage, Prefabs[i].Geometry[j]);
+            }
+            Written.Prefabs.Size = (std::uint64_t)Stage.tellp() - Written.Prefabs.Offset;
+        }
+
+        Written.Screens.resize(StageData.size());
+        for (unsigned int i = 0; i < StageData.size(); i++)
+        {
+            if (!StageData[i].Dirty)
+                continue;
+
+            Written.Screens[i].Offset = Stage.tellp();
+            Stage.write((char*)&StageData[i].StartPosition.x, sizeof(float));
+            Stage.write((char*)&StageData[i].StartPosition.y, sizeof(float));
+            Stage.write((char*)&StageData[i].nPlatforms, sizeof(unsigned int));
+            for (unsigned int j = 0; j < StageData[i].nPlatforms; j++)
+                WritePlatform(Stage, StageData[i].Platforms[j]);
+
+            Stage.write((char*)&StageData[i].nInstances, sizeof(unsigned int));
+            for (unsigned int j = 0; j < StageData[i].nInstances; j++)
+            {
+                Stage.write((char*)&StageData[i].Instances[j].Prefab, sizeof(unsigned int));
+                Stage.write((char*)&StageData[i].Instances[j].Translation.x, sizeof(float));
+                Stage.write((char*)&StageData[i].Instances[j].Translation.y, sizeof(float));
+            }
+            Written.Screens[i].Size = (std::uint64_t)Stage.tellp() - Written.Screens[i].Offset;
+        }
+
+        std::uint64_t DirectoryOffset = WriteDirectory(Stage, Written);
+        Written.FileSize = Stage.tellp();
+        Stage.flush();
+
+        //Only repoint the header when the blocks and the directory are on disk
+        if (Stage.good())
+        {
+            Stage.seekp(sizeof(StageFileMagic) + sizeof(unsigned int));
+            Stage.write((char*)&DirectoryOffset, sizeof(std::uint64_t));
+        }
+        Stage.close();
+
+        if (Stage.fail())
+        {
+            LOG_ERROR(LOG_EXPORT, "Writing {} failed, {} blocks are still pending export", Filename, nDirty);
+            return;
+        }
+
+        Directory = Written;
+        PrefabsDirty = false;
+        for (unsigned int i = 0; i < StageData.size(); i++)
+            StageData[i].Dirty = false;
+        LOG_INFO(LOG_EXPORT, "Level data exported succesfully ({} blocks written)", nDirty);
+
+        //Superseded blocks stay in the file until more than half of it is dead space
+        if (Directory.FileSize > StageFileCompactionThreshold && Directory.FileSize > 2 * Directory.LiveSize())
+            Compaction = std::async(std::launch::async, CompactStageFile, Filename, Directory);
+    }
+ 
+    void ExportToFileTest()
+    {
+        if (Compaction.valid())
+            Directory = Compaction.get();
+
+        std::fstream Stage;
+        Stage.open(Filename, std::ios::in | std::ios::binary);
+
+        StageDirectory Imported;
+        if (!ReadDirectory(Stage, Imported))
+        {
+            LOG_WARN(LOG_IMPORT, "{} is not a stage file", Filename);
+            return;
+        }
+
+        Stage.seekg(Imported.Prefabs.Offset);
+        unsigned int nPrefabs;
+        Stage.read((char*)&nPrefabs, sizeof(unsigned int));
+        LOG_INFO(LOG_IMPORT, "{} prefabs", nPrefabs);
+
+        for (unsigned int i = 0; i < nPrefabs; i++)
+        {
+            unsigned int nPlatforms;
+            Stage.read((char*)&nPlatforms, sizeof(unsigned int));
+            LOG_INFO(LOG_IMPORT, "Prefab {}: {} platforms", i, nPlatforms);
+
+            for (unsigned int j = 0; j < nPlatforms; j++)
+            {
+                Box2DPlatform platform;
+                Stage.read((char*)&platform.nVerteces, sizeof(unsigned int));
+                LOG_TRACE(LOG_IMPORT, "{} verteces", platform.nVerteces);
+
+                for (unsigned int l = 0; l < platform.nVerteces; l++)
+                {
+                    Vector2D vertex;
+                    Stage.read((char*)&vertex.x, sizeof(float));
+                    Stage.read((char*)&vertex.y, sizeof(float));
+                    LOG_TRACE(LOG_IMPORT, "{} | {}", vertex.x, vertex.y);
+                }
+
+                Stage.read((char*)&platform.Type, sizeof(unsigned int));
+                Stage.read((char*)&platform.Mat, sizeof(unsigned int));
+                LOG_TRACE(LOG_IMPORT, "Type {} Mat {}", platform.Type, platform.Mat);
+            }
+        }
+
+        unsigned int nScreens = Imported.Screens.size();
+        LOG_INFO(LOG_IMPORT, "{} screens", nScreens);
+        Screen* ImportedScreens = new Screen[nScreens];
+
+        for (unsigned int i = 0; i < nScreens; i++)
+        {
+            Stage.seekg(Imported.Screens[i].Offset);
+            Stage.read((char*)&ImportedScreens[i].StartPosition.x, sizeof(float));
+            Stage.read((char*)&ImportedScreens[i].StartPosition.y, sizeof(float));
+            Stage.read((char*)&ImportedScreens[i].nPlatforms, sizeof(unsigned int));
+            LOG_INFO(LOG_IMPORT, "Screen {}: start {} | {}, {} platforms", i, ImportedScreens[i].StartPosition.x, ImportedScreens[i].StartPosition.y,
+                ImportedScreens[i].nPlatforms);
+            
+            ImportedScreens[i].Platforms = new Box2DPlatform[ImportedScreens[i].nPlatforms];
+            
+            for (unsigned int j = 0; j < ImportedScreens[i].nPlatforms; j++)
+            {
+                Stage.read((char*)&ImportedScreens[i].Platforms[j].nVerteces, sizeof(unsigned int));
+                LOG_TRACE(LOG_IMPORT, "{} verteces", ImportedScreens[i].Platforms[j].nVerteces);
+                ImportedScreens[i].Platforms[j].Verteces = new Vector2D[ImportedScreens[i].Platforms[j].nVerteces];
+
+                for (unsigned int l = 0; l < ImportedScreens[i].Platforms[j].nVerteces; l++)
+                {
+                    Stage.read((char*)&ImportedScreens[i].Platforms[j].Verteces[l].x, sizeof(float));
+                    Stage.read((char*)&ImportedScreens[i].Platforms[j].Verteces[l].y, sizeof(float));
+                    LOG_TRACE(LOG_IMPORT, "{} | {}", ImportedScreens[i].Platforms[j].Verteces[l].x, ImportedScreens[i].Platforms[j].Verteces[l].y);
+                }
+                    
+                Stage.read((char*)&ImportedScreens[i].Platforms[j].Type, sizeof(unsigned int));
+                Stage.read((char*)&ImportedScreens[i].Platforms[j].Mat, sizeof(unsigned int));
+                LOG_TRACE(LOG_IMPORT, "Type {} Mat {}", ImportedScreens[i].Platforms[j].Type, ImportedScreens[i].Platforms[j].Mat);
+            }
+
+            Stage.read((char*)&ImportedScreens[i].nInstances, sizeof(unsigned int));
+            LOG_INFO(LOG_IMPORT, "Screen {}: {} instances", i, ImportedScreens[i].nInstances);
+
+            ImportedScreens[i].Instances = new Box2DInstance[ImportedScreens[i].nInstances];
+
+            for (unsigned int j = 0; j < ImportedScreens[i].nInstances; j++)
+            {
+                Stage.read((char*)&ImportedScreens[i].Instances[j].Prefab, sizeof(unsigned int));
+                Stage.read((char*)&ImportedScreens[i].Instances[j].Translation.x, sizeof(float));
+                Stage.read((char*)&ImportedScreens[i].Instances[j].Translation.y, sizeof(float));
+                LOG_TRACE(LOG_IMPORT, "Prefab {} @ {} | {}", ImportedScreens[i].Instances[j].Prefab, ImportedScreens[i].Instances[j].Translation.x,
+                    ImportedScreens[i].Instances[j].Translation.y);
+            }
+        }        
+        
+        Stage.close();
+    }
+
+    unsigned int GetDirtyScreens()
+    {
+        unsigned int nDirty = 0;
+        for (unsigned int i = 0; i < StageData.size(); i++)
+            nDirty += StageData[i].Dirty;
+        return nDirty;
+    }
+
+    unsigned int GetScreensExported()
+    {
+        return ScreensExported;
+    }
+};
+
+//Shared by the live loop and the replay driver. Returns false when the rest of the pass
+//(held-key actions and rendering) is skipped, which is what happens on key events.
+//e keeps the last event between polls, newEvent tells whether it arrived on this pass:
+//one-shot shortcuts only fire on that pass, held keys are read from Keyboard instead.
+bool HandleInput(Stage& stage, const SDL_Event& e, const bool& newEvent, const uint8_t* Keyboard, const int& Mouse_x, const int& Mouse_y, bool& quit)
+{
+    if (e.type == SDL_QUIT)
+        quit = true;
+
+    else if (e.type == SDL_KEYDOWN)
+    {
+        if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_D && Keyboard[SDL_SCANCODE_LCTRL])
+            stage.DuplicateSelectedInstances(Vector2Di(40, 0));
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_E)
+        {
+            if (!stage.Platforms.empty() || !stage.Instances.empty())
+                stage.ExportScreen();
+        }
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_R && Keyboard[SDL_SCANCODE_LSHIFT])
+        {
+            if (!stage.StageData.empty())
+                stage.ExportToFile();
+        }
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_PAGEUP)
+            stage.EditScreen(stage.CurrentScreen < 0 ? (int)stage.StageData.size() - 1 : stage.CurrentScreen - 1);
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_PAGEDOWN)
+            stage.EditScreen(stage.CurrentScreen + 1);
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_M)
+            stage.Map.Toggle();
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_Z && Keyboard[SDL_SCANCODE_LCTRL])
+            stage.Undo();
+        else if (newEvent && !e.key.repeat && e.key.keysym.scancode == SDL_SCANCODE_Y && Keyboard[SDL_SCANCODE_LCTRL])
+            stage.Redo();
+        return false;
+    }
+
+    else if (e.type == SDL_KEYUP)
+    {
+        //Releasing a key ends the current move, the next one starts a new history entry
+        stage.History.Seal();
+        if (!Keyboard[SDL_SCANCODE_LCTRL])
+        {
+            stage.EdgeQueue.clear();
+        }
+        return false;
+    }
+         
+    else if (e.type == SDL_MOUSEBUTTONDOWN)
+    {
+        if(e.button.button == SDL_BUTTON_LEFT)
+        {
+            if (Keyboard[SDL_SCANCODE_LSHIFT])
+            {
+                Vector2Di cell = Vector2Di((int)(Mouse_x / 40), (int)(Mouse_y / 40));
+                stage.AddPlatform(Platform(Vector2Di(cell.x * 40 + 20, cell.y * 40 + 20)));
+            }
+
+            else if (Keyboard[SDL_SCANCODE_S])
+                stage.SetStartPosition(Vector2Di(Mouse_x, Mouse_y));
+
+            else if (Keyboard[SDL_SCANCODE_P])
+                stage.PlaceInstance(Vector2Di(Mouse_x, Mouse_y));
+            
+            else if (Keyboard[SDL_SCANCODE_LCTRL])
+            {
+                Vector2Di point = Vector2Di((int)(Mouse_x / 40), (int)(Mouse_y / 40));
+                stage.AddEdge(SDL_Point(point.x * 40, point.y * 40));
+            }
+        }
         
-        stage.RenderPlatforms(Renderer);
-        stage.RenderEdges(Renderer);
-        SDL_RenderPresent(Renderer);
+        else if(e.button.button == SDL_BUTTON_RIGHT)
+        {
+            for (int i = 0; i < stage.Platforms.size(); i++)
+            {
+                if (stage.Platforms[i].Collision(Vector2Di(Mouse_x, Mouse_y)))
+                {
+                    if (!stage.Platforms[i].isSelected())
+                        stage.Platforms[i].Select();
+                    else
+                        stage.Platforms[i].Deselect();
+                }    
+            }
+
+            for (int i = 0; i < stage.Instances.size(); i++)
+            {
+                if (stage.Instances[i].Collision(Vector2Di(Mouse_x, Mouse_y), stage.Prefabs[stage.Instances[i].GetSource()]))
+                {
+                    if (!stage.Instances[i].isSelected())
+                        stage.Instances[i].Select();
+                    else
+                        stage.Instances[i].Deselect();
+                }
+            }
+        }
+    }
+
+    else if (Keyboard[SDL_SCANCODE_DELETE])
+    {
+        stage.DeleteSelection();
+    }
+
+    else if (Keyboard[SDL_SCANCODE_P] && Keyboard[SDL_SCANCODE_LSHIFT])
+    {
+        stage.CreatePrefabFromSelection();
+    }
+
+    else if (Keyboard[SDL_SCANCODE_C] && Keyboard[SDL_SCANCODE_LCTRL])
+    {
+        if (!stage.EdgeQueue.empty())
+        {
+            stage.AddPlatform(Platform(stage.EdgeQueue));
+            stage.EdgeQueue.clear();
+        }
+    }
+       
+    else if (Keyboard[SDL_SCANCODE_A])
+    {
+        stage.RetypeSelection(PlatformType::ANCHOR);
+    }
+
+    else if (Keyboard[SDL_SCANCODE_T])
+    {
+        stage.ExportToFileTest();
+    }
+
+        
+    else if (Keyboard[SDL_SCANCODE_RIGHT])
+    {
+        stage.MoveSelection(Vector2Di(4, 0));
+    }
+    if (Keyboard[SDL_SCANCODE_LEFT])
+    {
+        stage.MoveSelection(Vector2Di(-4, 0));
+    }
+    if (Keyboard[SDL_SCANCODE_UP])
+    {
+        stage.MoveSelection(Vector2Di(0, -4));
+    }
+    if (Keyboard[SDL_SCANCODE_DOWN])
+    {
+        stage.MoveSelection(Vector2Di(0, 4));
+    }
+
+    return true;
+}
+
+void RenderFrame(SDL_Renderer* renderer, Stage& stage, TTF_Font* font)
+{
+    SDL_SetRenderDrawColor(renderer, 25, 25, 25, 255);
+    SDL_RenderClear(renderer);
+
+    DrawGridline(40, renderer);
+    DrawCartesianAxis(renderer);        
+
+    std::stringstream info;
+    
+
+    info << "Screens exported: " << stage.GetScreensExported() << " (" << stage.GetDirtyScreens() << " modified)";
+    RenderText(renderer, "not_yet Level Editor", {10, 10}, font, SDL_Color(255, 255, 255, 150));
+    RenderText(renderer, "by memcpy", {10, 22}, font, SDL_Color(255, 255, 255, 150));
+    RenderText(renderer, info.str().c_str(), {10, 34}, font, SDL_Color(255, 255, 255, 150));
+    
+    
+    stage.RenderPlatforms(renderer);
+    stage.RenderEdges(renderer);
+    stage.RenderMinimap(renderer);
+    SDL_RenderPresent(renderer);
+}
+
+//Feeds a recorded input trace through HandleInput/RenderFrame as fast as possible, rendering
+//into an offscreen surface, and writes the time spent on every pass to <trace>.csv. Exports go to <trace>.bin.
+int Replay(const std::string& path, const std::size_t& historyCapacity)
+{
+    InputPlayer Player;
+    if (!Player.Open(path))
+        return 1;
+
+    TTF_Init();
+    SDL_Surface* Target = SDL_CreateRGBSurfaceWithFormat(0, ScreenArea.w, ScreenArea.h, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* Renderer = Target ? SDL_CreateSoftwareRenderer(Target) : nullptr;
+    if (!Renderer)
+    {
+        LOG_ERROR(LOG_INPUT, "Could not create offscreen renderer: {}", SDL_GetError());
+        return 1;
+    }
+
+    TTF_Font* MonoFont = TTF_OpenFont("../../res/FreeMono.ttf", 15);
+
+    //Exports triggered by the trace go next to it, never over the level files of a live session
+    Stage stage;
+    stage.Filename = path + ".bin";
+    stage.History.SetCapacity(historyCapacity);
+    SDL_Event e;
+    std::memset(&e, 0, sizeof(SDL_Event));
+    Uint8 Keyboard[SDL_NUM_SCANCODES] = {0};
+    int Mouse_x = 0;
+    int Mouse_y = 0;
+    bool quit = 0;
+    bool NewEvent = 0;
+    Uint32 Recorded = 0;
+
+    std::vector<double> Timings;
+    std::fstream Report;
+    Report.open(path + ".csv", std::ios::out | std::ios::trunc);
+    //recorded_interval_ms is the wall-clock time since the previous recorded pass of the live session
+    //(vsync wait included), replayed_work_ms only the time spent handling and rendering the pass here
+    Report << "frame,recorded_interval_ms,replayed_work_ms\n";
+
+    const double Frequency = SDL_GetPerformanceFrequency();
+    while (Player.Next(e, NewEvent, Keyboard, Mouse_x, Mouse_y, Recorded))
+    {
+        Uint64 Start = SDL_GetPerformanceCounter();
+        bool Handled = HandleInput(stage, e, NewEvent, Keyboard, Mouse_x, Mouse_y, quit);
+        if (Handled)
+            RenderFrame(Renderer, stage, MonoFont);
+
+        //Passes that only saw a stale key event did nothing and would skew the percentiles
+        if (!Handled && !NewEvent)
+            continue;
+
+        Timings.push_back((SDL_GetPerformanceCounter() - Start) * 1000.0 / Frequency);
+        Report << Timings.size() - 1 << ',' << Recorded / 1000.0 << ',' << Timings.back() << '\n';
+    }
+    Report.close();
+
+    if (!Timings.empty())
+    {
+        double Total = 0;
+        for (int i = 0; i < Timings.size(); i++)
+            Total += Timings[i];
+
+        std::sort(Timings.begin(), Timings.end());
+        auto Percentile = [&](const double& p) { return Timings[(std::size_t)(p * (Timings.size() - 1))]; };
+        LOG_INFO(LOG_INPUT, "Replayed {} frames in {} ms: mean {} ms, p50 {} ms, p99 {} ms, max {} ms", Timings.size(), Total,
+            Total / Timings.size(), Percentile(0.5), Percentile(0.99), Timings.back());
+    }
+
+    SDL_DestroyRenderer(Renderer);
+    SDL_FreeSurface(Target);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int Width = 1280;
+    int Height = 720;
+
+    int Mouse_x = 0;
+    int Mouse_y = 0;
+
+    Log::Start();
+
+    std::string ReplayPath;
+    std::string RecordPath;
+    std::size_t HistoryCapacity = 64;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) == "--replay")
+            ReplayPath = argv[++i];
+        else if (std::string(argv[i]) == "--record")
+            RecordPath = argv[++i];
+        else if (std::string(argv[i]) == "--history")
+            HistoryCapacity = std::strtoul(argv[++i], nullptr, 10);
+    }
+
+    if (!ReplayPath.empty())
+    {
+        int Result = Replay(ReplayPath, HistoryCapacity * 1024 * 1024);
+        Log::Stop();
+        return Result;
+    }
+
+    InputRecorder Recorder;
+    if (!RecordPath.empty())
+        Recorder.Open(RecordPath);
+
+    if (SDL_Init(SDL_INIT_EVERYTHING) < 0)
+    {
+        std::cout << "[SDL2]: SDL_Init() failed   : " << SDL_GetError() << '\n';
+        return 0;
+    }
+
+    if (TTF_Init() < 0)
+    {
+        std::cout << "[SDL_ttf]: TTF_Init() failed   : " << TTF_GetError() << '\n';
+        return 0;
+    }
+
+    SDL_Window* Window = SDL_CreateWindow("not_yet_level_editor", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, Width, Height, SDL_WINDOW_SHOWN);
+    if (!Window)
+    {
+        std::cout << "[SDL_CreateWindow]: Could not create window.   : " << SDL_GetError() << std::endl;
+        return 0;
+    }
+
+    SDL_Renderer* Renderer = SDL_CreateRenderer(Window, -1, SDL_RENDERER_ACCELERATED + SDL_RENDERER_PRESENTVSYNC);
+
+    if (!Renderer)
+    {
+        std::cout << "[SDL2]: Could not create renderer.   : " << SDL_GetError() << std::endl;
+        return 0;
+    }
+
+    Stage stage;
+    stage.History.SetCapacity(HistoryCapacity * 1024 * 1024);
+
+    SDL_Event e = {};
+    bool quit = 0;
+    const uint8_t* Keyboard = SDL_GetKeyboardState(0);
+            
+    TTF_Font* MonoFont = TTF_OpenFont("../../res/FreeMono.ttf", 15);
+    if (!MonoFont)
+        std::cout << "[SDL_ttf] TTF_OpenFont() failed   : " << TTF_GetError() << '\n';
+
+    int NewEvent = 0;
+    while (!quit + (NewEvent = SDL_PollEvent(&e)))
+    {
+        SDL_GetMouseState(&Mouse_x, &Mouse_y);
+        bool Handled = HandleInput(stage, e, NewEvent, Keyboard, Mouse_x, Mouse_y, quit);
+
+        //While a key is held with no newer event, every pass sees the same stale key event and does
+        //nothing, so only passes that got an event or rendered go into the trace
+        if (Recorder.isOpen() && (NewEvent || Handled))
+            Recorder.Record(NewEvent ? &e : nullptr, Keyboard, Mouse_x, Mouse_y);
+
+        if (!Handled)
+            continue;
+
+        RenderFrame(Renderer, stage, MonoFont);
     }
 
+    Recorder.Close();
+    Log::Stop();
     SDL_Quit();
 }
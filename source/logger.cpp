@@ -0,0 +1,196 @@
+//STL
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+//vendor
+#include "Logger.h"
+
+namespace Log
+{
+    //Bounded multi-producer ring (Vyukov): each slot carries a sequence number telling producers
+    //whether it is free and the single consumer whether it has been published.
+    constexpr std::size_t Capacity = 1024;
+    constexpr std::size_t Mask = Capacity - 1;
+    static_assert((Capacity & Mask) == 0, "Log capacity must be a power of two");
+
+    struct Slot
+    {
+        std::atomic<std::size_t> Sequence;
+        Record Data;
+    };
+
+    struct Ring
+    {
+        Slot Slots[Capacity];
+        std::atomic<std::size_t> EnqueuePos;
+        std::size_t DequeuePos;
+
+        Ring()
+            : EnqueuePos(0), DequeuePos(0)
+        {
+            for (std::size_t i = 0; i < Capacity; i++)
+                Slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    };
+
+    static Ring Queue;
+    static std::atomic<std::size_t> Dropped = 0;
+    static std::atomic<bool> Running = false;
+    static std::thread Flusher;
+    static std::FILE* Output = nullptr;
+    static std::int64_t Epoch = 0;
+
+    bool Enqueue(const Record& record)
+    {
+        std::size_t pos = Queue.EnqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &Queue.Slots[pos & Mask];
+            std::size_t seq = slot->Sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+
+            if (diff == 0)
+            {
+                if (Queue.EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                Dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                pos = Queue.EnqueuePos.load(std::memory_order_relaxed);
+        }
+
+        slot->Data = record;
+        slot->Sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    static bool Dequeue(Record& record)
+    {
+        Slot& slot = Queue.Slots[Queue.DequeuePos & Mask];
+        if (slot.Sequence.load(std::memory_order_acquire) != Queue.DequeuePos + 1)
+            return false;
+
+        record = slot.Data;
+        slot.Sequence.store(Queue.DequeuePos + Capacity, std::memory_order_release);
+        ++Queue.DequeuePos;
+        return true;
+    }
+
+    static void Format(const Record& record, std::string& line)
+    {
+        static const char* Levels[] = { "TRACE", "INFO", "WARN", "ERROR" };
+        static const char* Categories[] = { "EDIT", "EXPORT", "IMPORT", "RENDER", "INPUT" };
+
+        const char* category = "";
+        for (int i = 0; i < sizeof(Categories) / sizeof(Categories[0]); i++)
+        {
+            if (record.Category & (1 << i))
+                category = Categories[i];
+        }
+
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "[%10.3f][%s][%s] ", (record.Time - Epoch) / 1e9, Levels[record.Level], category);
+        line = prefix;
+
+        unsigned int arg = 0;
+        for (const char* c = record.Format; *c; ++c)
+        {
+            if (c[0] == '{' && c[1] == '}' && arg < record.nArguments)
+            {
+                const Argument& a = record.Arguments[arg++];
+                switch (a.Type)
+                {
+                case Argument::INT:    line += std::to_string(a.i); break;
+                case Argument::UINT:   line += std::to_string(a.u); break;
+                case Argument::STRING: line.append(record.Text + a.s.Offset, a.s.Length); break;
+                case Argument::FLOAT:
+                    char number[32];
+                    std::snprintf(number, sizeof(number), "%g", a.f);
+                    line += number;
+                    break;
+                }
+                ++c;
+            }
+            else
+                line += *c;
+        }
+        line += '\n';
+    }
+
+    static void Drain()
+    {
+        Record record;
+        std::string line;
+        bool wrote = false;
+
+        while (Dequeue(record))
+        {
+            Format(record, line);
+            std::fputs(line.c_str(), Output);
+            wrote = true;
+        }
+
+        std::size_t dropped = Dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped)
+            std::fprintf(Output, "[WARN] %zu log records dropped, ring buffer full\n", dropped);
+
+        if (wrote || dropped)
+            std::fflush(Output);
+    }
+
+    bool Start(const char* path)
+    {
+        if (Running)
+            return true;
+
+        Output = path ? std::fopen(path, "w") : stderr;
+        if (!Output)
+        {
+            Output = stderr;
+            std::fprintf(stderr, "[WARN] Could not open log file %s, logging to stderr\n", path);
+        }
+
+        Epoch = std::chrono::steady_clock::now().time_since_epoch().count();
+        Running = true;
+        Flusher = std::thread([]()
+        {
+            while (Running.load(std::memory_order_relaxed))
+            {
+                Drain();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            Drain();
+        });
+
+        return Output != stderr || !path;
+    }
+
+    void Stop()
+    {
+        if (!Running)
+            return;
+
+        Running = false;
+        Flusher.join();
+        if (Output != stderr)
+            std::fclose(Output);
+        Output = nullptr;
+    }
+
+    //Declared after Flusher so it is destroyed first: a missed Stop() still drains the ring
+    //and joins the thread instead of destroying it joinable
+    static struct Shutdown
+    {
+        ~Shutdown()
+        {
+            Stop();
+        }
+    } Guard;
+}
@@ -0,0 +1,156 @@
+//SDL
+#include <SDL.h>
+//STL
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+//vendor
+#include <SDL_prims.h>
+#include "Logger.h"
+#include "Minimap.h"
+
+Minimap::Minimap()
+    : Running(true), Atlas(nullptr), Rows(0), Visible(true)
+{
+    unsigned int nWorkers = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+    for (unsigned int i = 0; i < nWorkers; i++)
+        Workers.push_back(std::thread(&Minimap::Work, this));
+}
+
+Minimap::~Minimap()
+{
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Running = false;
+    }
+    Wake.notify_all();
+    for (int i = 0; i < Workers.size(); i++)
+        Workers[i].join();
+
+    for (int i = 0; i < Results.size(); i++)
+        SDL_FreeSurface(Results[i].Thumbnail);
+    for (int i = 0; i < Thumbnails.size(); i++)
+        SDL_FreeSurface(Thumbnails[i]);
+    //The atlas is released together with the renderer that created it
+}
+
+void Minimap::Work()
+{
+    const float Scale = (float)ThumbnailWidth / ScreenWidth;
+    std::vector<SDL_Point> Scaled;
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(Lock);
+            Wake.wait(guard, [this]() { return !Running || !Jobs.empty(); });
+            if (!Running)
+                return;
+
+            job = std::move(Jobs.front());
+            Jobs.pop_front();
+        }
+
+        SDL_Surface* Thumbnail = SDL_CreateRGBSurfaceWithFormat(0, ThumbnailWidth, ThumbnailHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!Thumbnail)
+        {
+            LOG_ERROR(LOG_RENDER, "Could not create minimap thumbnail: {}", SDL_GetError());
+            continue;
+        }
+
+        SDL_FillRect(Thumbnail, nullptr, SDL_MapRGBA(Thumbnail->format, 40, 40, 40, 255));
+        for (int i = 0; i < job.Polygons.size(); i++)
+        {
+            const Polygon& polygon = job.Polygons[i];
+            Scaled.resize(polygon.Verteces.size());
+            for (int j = 0; j < polygon.Verteces.size(); j++)
+                Scaled[j] = SDL_Point((int)std::lround(polygon.Verteces[j].x * Scale), (int)std::lround(polygon.Verteces[j].y * Scale));
+
+            SDL_FillPolygonSurface(Thumbnail, Scaled.data(), Scaled.size(),
+                SDL_MapRGBA(Thumbnail->format, polygon.Color.r, polygon.Color.g, polygon.Color.b, polygon.Color.a));
+        }
+
+        std::lock_guard<std::mutex> guard(Lock);
+        Results.push_back({job.Screen, job.Revision, Thumbnail});
+    }
+}
+
+bool Minimap::isStale(const unsigned int& screen, const unsigned int& revision)
+{
+    return screen >= Requested.size() || Requested[screen] != revision;
+}
+
+void Minimap::Submit(const unsigned int& screen, const unsigned int& revision, std::vector<Polygon>&& polygons)
+{
+    if (screen >= Requested.size())
+    {
+        Requested.resize(screen + 1, 0);
+        Thumbnails.resize(screen + 1, nullptr);
+    }
+    Requested[screen] = revision;
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Jobs.push_back({screen, revision, std::move(polygons)});
+    }
+    Wake.notify_one();
+}
+
+bool Minimap::Upload(const unsigned int& screen)
+{
+    SDL_Rect Cell = {(int)(screen % Columns) * ThumbnailWidth, (int)(screen / Columns) * ThumbnailHeight, ThumbnailWidth, ThumbnailHeight};
+    return SDL_UpdateTexture(Atlas, &Cell, Thumbnails[screen]->pixels, Thumbnails[screen]->pitch) == 0;
+}
+
+void Minimap::Render(SDL_Renderer* renderer, const SDL_Rect& panel)
+{
+    std::vector<Result> Finished;
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Finished.swap(Results);
+    }
+
+    const int RowsNeeded = (Requested.size() + Columns - 1) / Columns;
+    if (RowsNeeded > Rows)
+    {
+        //Grow geometrically and refill from the CPU copies, so regrowth stays rare
+        Rows = std::max(RowsNeeded, Rows * 2);
+        if (Atlas)
+            SDL_DestroyTexture(Atlas);
+        Atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, Columns * ThumbnailWidth, Rows * ThumbnailHeight);
+        if (!Atlas)
+            LOG_ERROR(LOG_RENDER, "Could not create minimap atlas: {}", SDL_GetError());
+
+        for (unsigned int i = 0; Atlas && i < Thumbnails.size(); i++)
+        {
+            if (Thumbnails[i])
+                Upload(i);
+        }
+    }
+
+    for (int i = 0; i < Finished.size(); i++)
+    {
+        //A newer revision was submitted while this one was rasterized
+        if (Finished[i].Revision != Requested[Finished[i].Screen])
+        {
+            SDL_FreeSurface(Finished[i].Thumbnail);
+            continue;
+        }
+
+        SDL_FreeSurface(Thumbnails[Finished[i].Screen]);
+        Thumbnails[Finished[i].Screen] = Finished[i].Thumbnail;
+        if (Atlas)
+            Upload(Finished[i].Screen);
+    }
+
+    if (!Visible || !Atlas || Requested.empty())
+        return;
+
+    const int UsedColumns = std::min<int>(Requested.size(), Columns);
+    SDL_Rect Source = {0, 0, UsedColumns * ThumbnailWidth, RowsNeeded * ThumbnailHeight};
+    float Scale = std::min({1.0f, (float)panel.w / Source.w, (float)panel.h / Source.h});
+    SDL_Rect Target = {panel.x + panel.w - (int)(Source.w * Scale), panel.y, (int)(Source.w * Scale), (int)(Source.h * Scale)};
+    SDL_RenderCopy(renderer, Atlas, &Source, &Target);
+}